@@ -0,0 +1,98 @@
+#include <avr/interrupt.h>
+
+#include "../src/clock.h"
+#include "../src/timer.h"
+#include "host.h"
+
+// Time of the pending alarm, in microseconds.
+static uint64_t alarm_at = HOST_NEVER;
+
+// The clock counts simulated time at the same rate as Timer1 would.
+void
+clock_init (void)
+{
+}
+
+uint32_t
+clock_now32 (void)
+{
+	return CLOCK_US_TICKS(host_now());
+}
+
+uint16_t
+clock_now (void)
+{
+	return clock_now32();
+}
+
+uint32_t
+clock_micros (void)
+{
+	return host_now();
+}
+
+uint32_t
+clock_millis (void)
+{
+	return host_now() / 1000;
+}
+
+// Sleep until the given time or the next interrupt. Returns true if the
+// time has been reached. Like the firmware version, enables interrupts.
+bool
+clock_sleep (const uint32_t until)
+{
+	const int32_t left = until - clock_now32();
+
+	sei();
+
+	if (left <= 0)
+		return true;
+
+	host_idle(host_now() + CLOCK_TICKS_US((uint32_t) left + CLOCK_US_TICKS(1) - 1));
+
+	return (int32_t) (until - clock_now32()) <= 0;
+}
+
+void
+clock_delay (const uint32_t us)
+{
+	const uint32_t until = clock_now32() + CLOCK_US_TICKS(us);
+
+	while (!clock_sleep(until))
+		continue;
+}
+
+// The alarm is due at the same microsecond as the compare match would be,
+// rounded up.
+void
+clock_alarm (const uint32_t when)
+{
+	const int32_t left = when - clock_now32();
+
+	alarm_at = host_now() + (left > 0 ? CLOCK_TICKS_US((uint32_t) left + CLOCK_US_TICKS(1) - 1) : 0);
+}
+
+void
+clock_alarm_off (void)
+{
+	alarm_at = HOST_NEVER;
+}
+
+// Get the time of the alarm.
+uint64_t
+host_clock_next (void)
+{
+	return alarm_at;
+}
+
+// Run the software timers if the alarm came due.
+void
+host_clock_run (void)
+{
+	if (alarm_at > host_now())
+		return;
+
+	alarm_at = HOST_NEVER;
+	timer_run();
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/eeprom.h>
+
+#include "host.h"
+
+// Time to erase and write one EEPROM cell.
+#define WRITE_US	3400
+
+// Bounds of the section that holds the EEMEM variables.
+extern uint8_t __start_host_eeprom[];
+extern uint8_t __stop_host_eeprom[];
+
+// Backing file, from RADIUNO_EEPROM, or NULL to start erased every time.
+static const char *path;
+
+// Start from an erased EEPROM, or load it from the backing file.
+__attribute__((constructor))
+static void
+init (void)
+{
+	const size_t size = __stop_host_eeprom - __start_host_eeprom;
+	FILE *f;
+
+	memset(__start_host_eeprom, 0xFF, size);
+
+	if ((path = getenv("RADIUNO_EEPROM")) && (f = fopen(path, "rb"))) {
+		if (fread(__start_host_eeprom, 1, size, f) != size)
+			memset(__start_host_eeprom, 0xFF, size);
+		fclose(f);
+	}
+}
+
+static void
+save (void)
+{
+	FILE *f;
+
+	if (!path || !(f = fopen(path, "wb")))
+		return;
+
+	fwrite(__start_host_eeprom, 1, __stop_host_eeprom - __start_host_eeprom, f);
+	fclose(f);
+}
+
+uint8_t
+eeprom_read_byte (const uint8_t *p)
+{
+	return *p;
+}
+
+void
+eeprom_read_block (void *dst, const void *src, size_t len)
+{
+	memcpy(dst, src, len);
+}
+
+void
+eeprom_update_byte (uint8_t *p, uint8_t val)
+{
+	eeprom_update_block(&val, p, 1);
+}
+
+// Like the real thing, only write the cells that change.
+void
+eeprom_update_block (const void *src, void *dst, size_t len)
+{
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	size_t writes = 0;
+
+	for (size_t i = 0; i < len; i++)
+		if (d[i] != s[i]) {
+			d[i] = s[i];
+			writes++;
+		}
+
+	if (writes == 0)
+		return;
+
+	host_busy(writes * WRITE_US);
+	save();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// No event pending.
+#define HOST_NEVER	UINT64_MAX
+
+// Simulator core, in host/sim.c. Time is kept in microseconds since startup.
+// In fast mode, time is virtual and only passes when the firmware waits;
+// in real-time mode, it follows the wall clock.
+extern bool     host_realtime (void);
+extern uint64_t host_now (void);
+extern void     host_busy (uint64_t us);
+extern void     host_delay (uint64_t us);
+extern void     host_idle (uint64_t until);
+extern void     host_irq (void);
+extern void     host_sleep (void);
+
+// Alarm of the software timers, in host/clock.c.
+extern uint64_t host_clock_next (void);
+extern void     host_clock_run (void);
+
+// Console side of the UART, in host/uart.c.
+extern uint64_t host_uart_next (void);
+extern void     host_uart_run (void);
+extern bool     host_uart_wait (uint64_t until);
+
+// Behavioral model of the si4735, in host/model.c.
+extern void     model_select (void);
+extern void     model_deselect (void);
+extern uint8_t  model_xfer (uint8_t out);
+extern uint64_t model_next (void);
+extern bool     model_run (void);
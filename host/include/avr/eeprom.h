@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// EEPROM variables live in a section of their own, which host/eeprom.c
+// erases at startup and optionally backs with a file.
+#define EEMEM	__attribute__((section("host_eeprom")))
+
+extern uint8_t eeprom_read_byte (const uint8_t *p);
+extern void eeprom_read_block (void *dst, const void *src, size_t len);
+extern void eeprom_update_byte (uint8_t *p, uint8_t val);
+extern void eeprom_update_block (const void *src, void *dst, size_t len);
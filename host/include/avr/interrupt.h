@@ -0,0 +1,13 @@
+#pragma once
+
+#include <avr/io.h>
+
+// On the host, interrupt handlers are ordinary functions that the simulator
+// calls while the firmware sleeps or waits on a peripheral.
+#define ISR(vector, ...)	void vector (void); void vector (void)
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+
+// The global interrupt enable flag, bit 7 of SREG.
+#define sei()	(SREG |= 0x80)
+#define cli()	(SREG &= ~0x80)
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-ins for the ATmega328p I/O registers. They are plain memory,
+// defined in host/sim.c; the simulator looks at the few that matter, such as
+// the interrupt masks and the Timer0 clock select.
+#define _BV(bit)	(1U << (bit))
+
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+extern volatile uint8_t TIFR0, TIFR1, TIFR2;
+extern volatile uint8_t EIFR, EIMSK, EICRA;
+extern volatile uint8_t GPIOR0, GPIOR1, GPIOR2;
+extern volatile uint8_t SPCR, SPSR, SPDR;
+extern volatile uint8_t SREG, MCUSR, PRR;
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2;
+extern volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, UBRR0;
+
+// Port pins.
+#define PORTB0	0
+#define PORTB1	1
+#define PORTB2	2
+#define PORTB3	3
+#define PORTB4	4
+#define PORTB5	5
+#define PORTD2	2
+#define PORTD3	3
+#define PORTD4	4
+
+// Power reduction.
+#define PRADC	0
+#define PRUSART0	1
+#define PRSPI	2
+#define PRTIM1	3
+#define PRTIM0	5
+#define PRTIM2	6
+#define PRTWI	7
+
+// External interrupts.
+#define ISC00	0
+#define ISC01	1
+#define INT0	0
+#define INTF0	0
+
+// SPI.
+#define SPR0	0
+#define SPR1	1
+#define MSTR	4
+#define SPE	6
+#define SPIE	7
+#define SPI2X	0
+#define SPIF	7
+
+// Timers.
+#define CS00	0
+#define CS01	1
+#define CS02	2
+#define WGM01	1
+#define TOIE0	0
+#define OCIE0A	1
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define TOIE1	0
+#define OCIE1A	1
+#define OCIE1B	2
+#define OCF1A	1
+#define TOV1	0
+#define CS20	0
+#define CS21	1
+#define CS22	2
+#define WGM21	1
+#define TOIE2	0
+#define OCIE2A	1
+#define OCF2A	1
+
+// USART.
+#define U2X0	1
+#define UPE0	2
+#define DOR0	3
+#define FE0	4
+#define UDRE0	5
+#define TXC0	6
+#define UCSZ00	1
+#define UCSZ01	2
+#define TXEN0	3
+#define RXEN0	4
+#define UDRIE0	5
+#define RXCIE0	7
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+// The host has a single address space, so flash accessors are plain reads.
+// Like the lpm instruction on the AVR, they hide where the pointer came
+// from: the command table is bounded by zero-length arrays, which the
+// compiler would otherwise consider empty.
+#define PROGMEM
+#define PGM_P		const char *
+#define PSTR(s)		(s)
+
+static inline const void *
+host_pgm (const void *p)
+{
+	__asm__ ("" : "+r" (p));
+	return p;
+}
+
+#define pgm_read_byte(p)	(*(const uint8_t  *) host_pgm(p))
+#define pgm_read_word(p)	(*(const uint16_t *) host_pgm(p))
+#define pgm_read_dword(p)	(*(const uint32_t *) host_pgm(p))
+#define pgm_read_ptr(p)		(*(void * const *) host_pgm(p))
+
+#define memcpy_P(d, s, n)		memcpy(d, host_pgm(s), n)
+#define strlen_P(s)			strlen(host_pgm(s))
+#define strcmp_P(a, b)			strcmp(a, host_pgm(b))
+#define strncmp_P(a, b, n)		strncmp(a, host_pgm(b), n)
+#define strcasecmp_P(a, b)		strcasecmp(a, host_pgm(b))
+#define strncasecmp_P(a, b, n)		strncasecmp(a, host_pgm(b), n)
+#define strpbrk_P(s, set)		strpbrk(s, host_pgm(set))
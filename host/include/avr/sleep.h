@@ -0,0 +1,12 @@
+#pragma once
+
+// Sleeping hands control to the simulator, which lets time pass until the
+// next event and runs the interrupt handlers that it triggers.
+#define SLEEP_MODE_IDLE	0
+
+extern void host_sleep (void);
+
+#define set_sleep_mode(mode)	((void) (mode))
+#define sleep_enable()		((void) 0)
+#define sleep_disable()		((void) 0)
+#define sleep_cpu()		host_sleep()
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <avr/interrupt.h>
+
+// Same semantics as avr-libc: disable interrupts for the duration of the
+// block, then restore or force on the interrupt flag.
+static inline uint8_t
+host_atomic_enter (void)
+{
+	const uint8_t sreg = SREG;
+
+	cli();
+	return sreg;
+}
+
+#define ATOMIC_RESTORESTATE	SREG = host_sreg
+#define ATOMIC_FORCEON		sei()
+
+#define ATOMIC_BLOCK(exit)						\
+	for (uint8_t host_sreg = host_atomic_enter(), host_once = 1;	\
+	     host_once; host_once = 0, exit)
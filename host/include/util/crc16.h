@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+// CRC-8 with polynomial 0x07, as in avr-libc.
+static inline uint8_t
+_crc8_ccitt_update (uint8_t crc, const uint8_t data)
+{
+	crc ^= data;
+
+	for (uint8_t i = 0; i < 8; i++)
+		crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+
+	return crc;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// Busy waits advance the simulated clock.
+extern void host_delay (uint64_t us);
+
+#define _delay_us(us)	host_delay(us)
+#define _delay_ms(ms)	host_delay((ms) * 1000ULL)
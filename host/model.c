@@ -0,0 +1,727 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/si4735_cmd.h"
+#include "../src/util.h"
+#include "host.h"
+
+// Behavioral model of the si4735 on the SPI bus. It decodes command frames,
+// answers status and response reads, and runs tuning, seeking and RDS
+// reception against a fixed table of stations in simulated time. The
+// timings are the typical figures from the datasheet.
+
+// Frame prefixes:
+#define CMD_WRITE	0x48
+#define CMD_READ_SHORT	0xA0
+#define CMD_READ_LONG	0xE0
+
+// Status byte:
+#define STCINT		0x01
+#define RDSINT		0x04
+#define ERR		0x40
+#define CTS		0x80
+
+// Timings, in microseconds.
+#define T_CMD		300		// Most commands
+#define T_POWER_UP	110000		// Crystal oscillator startup
+#define T_TUNE_FM	60000		// Tune, or one seek step
+#define T_TUNE_AM	80000
+#define T_FAST		4		// Divider for fast tunes
+#define T_RDS_GROUP	87600		// 104 bits at 1187.5 bit/s
+#define T_RDS_SYNC	(3 * T_RDS_GROUP)
+
+// Number of groups the RDS FIFO holds.
+#define RDS_FIFO	25
+
+// Extra properties that the driver does not define:
+#define PROP_FM_SEEK_SNR	0x1403
+#define PROP_FM_SEEK_RSSI	0x1404
+#define PROP_AM_SEEK_SNR	0x3403
+#define PROP_AM_SEEK_RSSI	0x3404
+
+// Known properties and their values after power up.
+static const struct {
+	uint16_t id;
+	uint16_t val;
+}
+defaults[] = {
+	{ SI4735_PROP_GPO_IEN,			0     },
+	{ SI4735_PROP_FM_SEEK_BAND_BOTTOM,	8750  },
+	{ SI4735_PROP_FM_SEEK_BAND_TOP,		10790 },
+	{ SI4735_PROP_FM_SEEK_FREQ_SPACING,	10    },
+	{ PROP_FM_SEEK_SNR,			3     },
+	{ PROP_FM_SEEK_RSSI,			20    },
+	{ SI4735_PROP_FM_RDS_INT_SOURCE,	0     },
+	{ SI4735_PROP_FM_RDS_INT_FIFO_COUNT,	0     },
+	{ SI4735_PROP_FM_RDS_CONFIG,		0     },
+	{ SI4735_PROP_AM_SEEK_BAND_BOTTOM,	520   },
+	{ SI4735_PROP_AM_SEEK_BAND_TOP,		1710  },
+	{ SI4735_PROP_AM_SEEK_FREQ_SPACING,	10    },
+	{ PROP_AM_SEEK_SNR,			5     },
+	{ PROP_AM_SEEK_RSSI,			25    },
+};
+
+// Stations on the air. FM frequencies are in units of 10 kHz, AM ones in
+// kHz. Stations with a program identifier broadcast RDS.
+static const struct station {
+	uint16_t    freq;
+	uint8_t     rssi;
+	uint8_t     snr;
+	uint16_t    pi;
+	uint8_t     pty;
+	const char *ps;
+	const char *rt;
+}
+fm[] = {
+	{ 8810,  48, 24, 0x8201, 10, "RADIO 1 ", "Radio 1 - the best music from the 80s, 90s and today" },
+	{ 8970,  32, 15, 0x8202, 14, "CLASSIC ", "Now playing: Bach - Brandenburg Concerto No. 3" },
+	{ 9250,  22,  6, 0x0000,  0, NULL, NULL },
+	{ 9480,  41, 20, 0x8203,  1, "NEWS 24 ", "Traffic and weather every ten minutes" },
+	{ 9930,  55, 28, 0x8204, 13, "JAZZ FM ", "Late night jazz with the house band" },
+	{ 10280, 17,  4, 0x0000,  0, NULL, NULL },
+	{ 10450, 37, 18, 0x8205, 11, "ROCK    ", "Rock around the clock" },
+},
+am[] = {
+	{ 198,   50, 20 },
+	{ 252,   30, 10 },
+	{ 600,   40, 12 },
+	{ 750,   33, 10 },
+	{ 1010,  45, 15 },
+	{ 1300,  28,  8 },
+	{ 5975,  35, 10 },
+	{ 9410,  42, 14 },
+	{ 15400, 30,  8 },
+};
+
+enum mode {
+	MODE_DOWN,
+	MODE_BOOT,
+	MODE_FM,
+	MODE_AM,
+};
+
+static struct {
+	enum mode mode;
+	enum mode boot;		// Mode to enter when booted
+	uint16_t  props[NELEM(defaults)];
+
+	// Command processing.
+	uint8_t   status;	// Interrupt and error bits
+	bool      ack;		// Answer the next status read with CTS once
+	bool      busy;		// Waiting for CTS
+	uint64_t  cts_at;
+	uint8_t   resp[16];
+
+	// Bus state.
+	uint8_t   prefix;	// Prefix of the current frame, or zero
+	uint8_t   frame[8];
+	uint8_t   pos;
+
+	// Tuning.
+	uint16_t  freq;
+	bool      tuning;	// Tune or seek in progress
+	bool      seeking;
+	bool      up;
+	bool      wrap;
+	bool      bltf;
+	uint16_t  steps;	// Seek steps left before giving up
+	uint64_t  stc_at;	// Completion of the tune or seek step
+
+	// RDS.
+	struct {
+		uint16_t group[RDS_FIFO][4];
+		uint8_t  head;
+		uint8_t  used;
+		uint8_t  seq;		// Position in the broadcast cycle
+		bool     sync;
+		bool     found;		// Synchronization found
+		bool     lost;		// FIFO overflowed
+		bool     recv;		// Threshold reached
+		uint64_t at;		// Arrival of the next group
+	} rds;
+
+	// Interrupt line pulsed.
+	bool      pulse;
+} chip;
+
+static uint16_t *
+prop (const uint16_t id)
+{
+	for (uint8_t i = 0; i < NELEM(defaults); i++)
+		if (defaults[i].id == id)
+			return &chip.props[i];
+
+	return NULL;
+}
+
+static uint16_t
+prop_val (const uint16_t id)
+{
+	return *prop(id);
+}
+
+// Raise interrupt bits, pulsing the line if they are enabled.
+static void
+raise (const uint8_t bits, const uint16_t ien)
+{
+	chip.status |= bits;
+
+	if (prop_val(SI4735_PROP_GPO_IEN) & ien)
+		chip.pulse = true;
+}
+
+static const struct station *
+station (const uint16_t freq)
+{
+	const struct station *s = chip.mode == MODE_FM ? fm : am;
+	const uint8_t n = chip.mode == MODE_FM ? NELEM(fm) : NELEM(am);
+
+	for (uint8_t i = 0; i < n; i++)
+		if (s[i].freq == freq)
+			return &s[i];
+
+	return NULL;
+}
+
+// Get the signal at a frequency: the station on it, half a neighbour's
+// signal one FM channel away, or a noise floor that varies per channel.
+static void
+signal (const uint16_t freq, uint8_t *rssi, uint8_t *snr)
+{
+	const struct station *s;
+
+	if ((s = station(freq)) != NULL) {
+		*rssi = s->rssi;
+		*snr  = s->snr;
+		return;
+	}
+
+	if (chip.mode == MODE_FM && ((s = station(freq - 10)) || (s = station(freq + 10)))) {
+		*rssi = s->rssi / 2;
+		*snr  = 0;
+		return;
+	}
+
+	*rssi = 2 + (freq * 7919U >> 3) % 8;
+	*snr  = (freq * 104729U >> 5) % 2;
+}
+
+static bool
+valid (const uint16_t freq)
+{
+	const bool fm = chip.mode == MODE_FM;
+	uint8_t rssi, snr;
+
+	signal(freq, &rssi, &snr);
+
+	return rssi >= prop_val(fm ? PROP_FM_SEEK_RSSI : PROP_AM_SEEK_RSSI)
+	    && snr  >= prop_val(fm ? PROP_FM_SEEK_SNR  : PROP_AM_SEEK_SNR);
+}
+
+// The station whose RDS data is being received, if any.
+static const struct station *
+rds_station (void)
+{
+	const struct station *s;
+
+	if (chip.mode != MODE_FM || chip.tuning)
+		return NULL;
+
+	if (!(prop_val(SI4735_PROP_FM_RDS_CONFIG) & 1))
+		return NULL;
+
+	if ((s = station(chip.freq)) == NULL || s->pi == 0)
+		return NULL;
+
+	return s;
+}
+
+static void
+rds_reset (void)
+{
+	chip.rds.head  = 0;
+	chip.rds.used  = 0;
+	chip.rds.seq   = 0;
+	chip.rds.sync  = false;
+	chip.rds.found = false;
+	chip.rds.lost  = false;
+	chip.rds.recv  = false;
+	chip.rds.at    = host_now() + T_RDS_SYNC;
+}
+
+// Get a character of RadioText. The text ends in a carriage return, unless
+// it fills all 64 characters, and is padded with spaces.
+static uint8_t
+rt_char (const char *rt, const uint8_t pos)
+{
+	const size_t len = strlen(rt);
+
+	return pos < len ? rt[pos] : pos == len ? '\r' : ' ';
+}
+
+// Number of four-character RadioText segments.
+static uint8_t
+rt_segments (const char *rt)
+{
+	const size_t len = strlen(rt);
+
+	return ((len < 64 ? len + 1 : 64) + 3) / 4;
+}
+
+// Receive the next group of the station's broadcast cycle, which alternates
+// between group 0A with two characters of the station name and group 2A
+// with four characters of RadioText.
+static void
+rds_receive (const struct station *s)
+{
+	const uint8_t seq = chip.rds.seq++;
+	uint16_t *g;
+
+	if (chip.rds.used == RDS_FIFO) {
+		chip.rds.head = (chip.rds.head + 1) % RDS_FIFO;
+		chip.rds.used--;
+		chip.rds.lost = true;
+	}
+
+	g = chip.rds.group[(chip.rds.head + chip.rds.used++) % RDS_FIFO];
+	g[0] = s->pi;
+
+	if (seq % 2 == 0) {
+		const uint8_t seg = (seq / 2) % 4;
+
+		g[1] = 0x0 << 12 | s->pty << 5 | 0x08 | seg;
+		g[2] = 0xE0CD;
+		g[3] = s->ps[seg * 2] << 8 | s->ps[seg * 2 + 1];
+	} else {
+		const uint8_t seg = (seq / 2) % rt_segments(s->rt);
+
+		g[1] = 0x2 << 12 | s->pty << 5 | seg;
+		g[2] = rt_char(s->rt, seg * 4 + 0) << 8 | rt_char(s->rt, seg * 4 + 1);
+		g[3] = rt_char(s->rt, seg * 4 + 2) << 8 | rt_char(s->rt, seg * 4 + 3);
+	}
+
+	if (!chip.rds.sync)
+		chip.rds.sync = chip.rds.found = true;
+
+	if ((prop_val(SI4735_PROP_FM_RDS_INT_SOURCE) & SI4735_PROP_FM_RDS_INT_SOURCE_RECV)
+	    && chip.rds.used >= prop_val(SI4735_PROP_FM_RDS_INT_FIFO_COUNT)
+	    && !(chip.status & RDSINT)) {
+		chip.rds.recv = true;
+		raise(RDSINT, SI4735_PROP_GPO_IEN_RDSIEN);
+	}
+}
+
+static void
+tune_done (void)
+{
+	chip.tuning  = false;
+	chip.seeking = false;
+	rds_reset();
+	raise(STCINT, SI4735_PROP_GPO_IEN_STCIEN);
+}
+
+// Move the seek one channel, and stop on a valid station or at the end of
+// the band.
+static void
+seek_step (void)
+{
+	const bool fm = chip.mode == MODE_FM;
+	const uint16_t lo   = prop_val(fm ? SI4735_PROP_FM_SEEK_BAND_BOTTOM : SI4735_PROP_AM_SEEK_BAND_BOTTOM);
+	const uint16_t hi   = prop_val(fm ? SI4735_PROP_FM_SEEK_BAND_TOP : SI4735_PROP_AM_SEEK_BAND_TOP);
+	const uint16_t step = prop_val(fm ? SI4735_PROP_FM_SEEK_FREQ_SPACING : SI4735_PROP_AM_SEEK_FREQ_SPACING);
+	uint16_t next = chip.up ? chip.freq + step : chip.freq - step;
+
+	if (next > hi || next < lo) {
+		if (!chip.wrap) {
+			chip.bltf = true;
+			tune_done();
+			return;
+		}
+		next = chip.up ? lo : hi;
+	}
+
+	chip.freq = next;
+
+	if (valid(next)) {
+		tune_done();
+		return;
+	}
+
+	// Having come full circle without a station, give up.
+	if (--chip.steps == 0) {
+		chip.bltf = true;
+		tune_done();
+		return;
+	}
+
+	chip.stc_at += fm ? T_TUNE_FM : T_TUNE_AM;
+}
+
+// Run the chip up to the current time.
+static void
+advance (void)
+{
+	const uint64_t now = host_now();
+	const struct station *s;
+
+	if (chip.busy && chip.cts_at <= now) {
+		chip.busy = false;
+
+		if (chip.mode == MODE_BOOT)
+			chip.mode = chip.boot;
+
+		if (prop_val(SI4735_PROP_GPO_IEN) & SI4735_PROP_GPO_IEN_CTSIEN)
+			chip.pulse = true;
+	}
+
+	while (chip.tuning && chip.stc_at <= now) {
+		if (chip.seeking)
+			seek_step();
+		else
+			tune_done();
+	}
+
+	while ((s = rds_station()) != NULL && chip.rds.at <= now) {
+		rds_receive(s);
+		chip.rds.at += T_RDS_GROUP;
+	}
+}
+
+uint64_t
+model_next (void)
+{
+	uint64_t next = HOST_NEVER;
+
+	if (chip.busy && (prop_val(SI4735_PROP_GPO_IEN) & SI4735_PROP_GPO_IEN_CTSIEN))
+		next = chip.cts_at;
+
+	if (chip.tuning && chip.stc_at < next)
+		next = chip.stc_at;
+
+	if (rds_station() && chip.rds.at < next)
+		next = chip.rds.at;
+
+	return next;
+}
+
+// Run the chip, and return whether it pulsed its interrupt line.
+bool
+model_run (void)
+{
+	const bool pulse = (advance(), chip.pulse);
+
+	chip.pulse = false;
+	return pulse;
+}
+
+static void
+power_up (const uint8_t *f)
+{
+	const uint8_t func = f[1] & 0x0F;
+
+	if (chip.mode != MODE_DOWN || func > SI4735_CMD_POWER_UP_FUNC_AM_RECV) {
+		chip.status |= ERR;
+		return;
+	}
+
+	for (uint8_t i = 0; i < NELEM(defaults); i++)
+		chip.props[i] = defaults[i].val;
+
+	// The CTSIEN bit enables the interrupt on Clear To Send.
+	if (f[1] & 0x80)
+		*prop(SI4735_PROP_GPO_IEN) = SI4735_PROP_GPO_IEN_CTSIEN;
+
+	chip.boot   = func == SI4735_CMD_POWER_UP_FUNC_FM_RECV ? MODE_FM : MODE_AM;
+	chip.mode   = MODE_BOOT;
+	chip.status = 0;
+	chip.ack    = true;
+	chip.cts_at = host_now() + T_POWER_UP;
+	chip.tuning = false;
+	chip.bltf   = false;
+	chip.freq   = prop_val(chip.boot == MODE_FM
+		? SI4735_PROP_FM_SEEK_BAND_BOTTOM
+		: SI4735_PROP_AM_SEEK_BAND_BOTTOM);
+}
+
+static void
+tune (const uint16_t freq, const bool fast)
+{
+	const bool fm = chip.mode == MODE_FM;
+
+	if (fm ? (freq < 6400 || freq > 10800 || freq % 5) : (freq < 149 || freq > 30000)) {
+		chip.status |= ERR;
+		return;
+	}
+
+	chip.status &= ~STCINT;
+	chip.freq    = freq;
+	chip.tuning  = true;
+	chip.seeking = false;
+	chip.bltf    = false;
+	chip.stc_at  = host_now() + (fm ? T_TUNE_FM : T_TUNE_AM) / (fast ? T_FAST : 1);
+}
+
+static void
+seek (const uint8_t flags)
+{
+	const bool fm = chip.mode == MODE_FM;
+	const uint16_t lo   = prop_val(fm ? SI4735_PROP_FM_SEEK_BAND_BOTTOM : SI4735_PROP_AM_SEEK_BAND_BOTTOM);
+	const uint16_t hi   = prop_val(fm ? SI4735_PROP_FM_SEEK_BAND_TOP : SI4735_PROP_AM_SEEK_BAND_TOP);
+	const uint16_t step = prop_val(fm ? SI4735_PROP_FM_SEEK_FREQ_SPACING : SI4735_PROP_AM_SEEK_FREQ_SPACING);
+
+	if (step == 0 || hi < lo) {
+		chip.status |= ERR;
+		return;
+	}
+
+	chip.status &= ~STCINT;
+	chip.up      = flags & 0x08;
+	chip.wrap    = flags & 0x04;
+	chip.tuning  = true;
+	chip.seeking = true;
+	chip.bltf    = false;
+	chip.steps   = (hi - lo) / step + 1;
+	chip.stc_at  = host_now() + (fm ? T_TUNE_FM : T_TUNE_AM);
+}
+
+static void
+tune_status (const uint8_t flags)
+{
+	uint8_t rssi, snr;
+
+	// Cancelling a seek completes it where it is.
+	if ((flags & 0x02) && chip.seeking) {
+		chip.seeking = false;
+		chip.stc_at  = host_now() + T_CMD;
+	}
+
+	if (flags & 0x01)
+		chip.status &= ~STCINT;
+
+	signal(chip.freq, &rssi, &snr);
+
+	chip.resp[1] = (chip.bltf ? 0x80 : 0) | (!chip.tuning && valid(chip.freq));
+	chip.resp[2] = chip.freq >> 8;
+	chip.resp[3] = chip.freq & 0xFF;
+	chip.resp[4] = chip.tuning ? 0 : rssi;
+	chip.resp[5] = chip.tuning ? 0 : snr;
+	chip.resp[6] = 0;
+	chip.resp[7] = 0;
+}
+
+static void
+rsq_status (void)
+{
+	uint8_t rssi, snr;
+
+	signal(chip.freq, &rssi, &snr);
+
+	if (chip.tuning)
+		rssi = snr = 0;
+
+	chip.resp[1] = 0;
+	chip.resp[2] = (!chip.tuning && valid(chip.freq)) | (snr < 2 ? 0x08 : 0);
+	chip.resp[3] = chip.mode == MODE_FM && rssi >= 30 ? 0x80 | (rssi > 50 ? 100 : rssi * 2) : 0;
+	chip.resp[4] = rssi;
+	chip.resp[5] = snr;
+	chip.resp[6] = rssi < 30 ? 30 - rssi : 0;
+	chip.resp[7] = 0;
+}
+
+static void
+rds_status (const uint8_t flags)
+{
+	const uint16_t *g = chip.rds.group[chip.rds.head];
+
+	if (flags & 0x02)
+		chip.rds.used = 0;
+
+	chip.resp[1] = chip.rds.recv | chip.rds.found << 2;
+	chip.resp[2] = chip.rds.sync | chip.rds.lost << 2;
+	chip.resp[3] = chip.rds.used;
+
+	for (uint8_t i = 0; i < 4; i++) {
+		chip.resp[4 + i * 2] = chip.rds.used ? g[i] >> 8 : 0;
+		chip.resp[5 + i * 2] = chip.rds.used ? g[i] & 0xFF : 0;
+	}
+
+	// No block errors.
+	chip.resp[12] = 0;
+
+	if (flags & 0x01) {
+		chip.status  &= ~RDSINT;
+		chip.rds.recv = chip.rds.found = chip.rds.lost = false;
+	}
+
+	if (chip.rds.used && !(flags & 0x04)) {
+		chip.rds.head = (chip.rds.head + 1) % RDS_FIFO;
+		chip.rds.used--;
+	}
+}
+
+// Execute a complete command frame.
+static void
+execute (const uint8_t *f)
+{
+	const bool up = chip.mode == MODE_FM || chip.mode == MODE_AM;
+	const bool fm = chip.mode == MODE_FM;
+	const bool am = chip.mode == MODE_AM;
+	uint16_t *p;
+
+	chip.status &= ~ERR;
+	chip.busy    = true;
+	chip.cts_at  = host_now() + T_CMD;
+
+	for (uint8_t i = 1; i < sizeof (chip.resp); i++)
+		chip.resp[i] = 0;
+
+	switch (f[0]) {
+	case SI4735_CMD_POWER_UP:
+		power_up(f);
+		return;
+
+	case SI4735_CMD_POWER_DOWN:
+		chip.mode   = MODE_DOWN;
+		chip.tuning = false;
+		chip.status = 0;
+		return;
+
+	case SI4735_CMD_GET_REV:
+		if (!up)
+			break;
+
+		chip.resp[1] = 35;
+		chip.resp[2] = '6';
+		chip.resp[3] = '0';
+		chip.resp[6] = '6';
+		chip.resp[7] = '0';
+		chip.resp[8] = 'C';
+		return;
+
+	case SI4735_CMD_SET_PROPERTY:
+		if (!up || (p = prop(f[2] << 8 | f[3])) == NULL)
+			break;
+
+		*p = f[4] << 8 | f[5];
+		return;
+
+	case SI4735_CMD_GET_PROPERTY:
+		if (!up || (p = prop(f[2] << 8 | f[3])) == NULL)
+			break;
+
+		chip.resp[2] = *p >> 8;
+		chip.resp[3] = *p & 0xFF;
+		return;
+
+	case SI4735_CMD_GET_INT_STATUS:
+		if (!up)
+			break;
+		return;
+
+	case SI4735_CMD_FM_TUNE_FREQ:
+	case SI4735_CMD_AM_TUNE_FREQ:
+		if (!(f[0] == SI4735_CMD_FM_TUNE_FREQ ? fm : am))
+			break;
+
+		tune(f[2] << 8 | f[3], f[1] & 0x01);
+		return;
+
+	case SI4735_CMD_FM_SEEK_START:
+	case SI4735_CMD_AM_SEEK_START:
+		if (!(f[0] == SI4735_CMD_FM_SEEK_START ? fm : am))
+			break;
+
+		seek(f[1]);
+		return;
+
+	case SI4735_CMD_FM_TUNE_STATUS:
+	case SI4735_CMD_AM_TUNE_STATUS:
+		if (!(f[0] == SI4735_CMD_FM_TUNE_STATUS ? fm : am))
+			break;
+
+		tune_status(f[1]);
+		return;
+
+	case SI4735_CMD_FM_RSQ_STATUS:
+	case SI4735_CMD_AM_RSQ_STATUS:
+		if (!(f[0] == SI4735_CMD_FM_RSQ_STATUS ? fm : am))
+			break;
+
+		rsq_status();
+		return;
+
+	case SI4735_CMD_FM_RDS_STATUS:
+		if (!fm)
+			break;
+
+		rds_status(f[1]);
+		return;
+	}
+
+	// Unknown command, or not available in this mode.
+	chip.status |= ERR;
+}
+
+// Get the status byte. After power up, the chip confirms reception with CTS
+// once, then reads all zeroes until it has booted.
+static uint8_t
+status (void)
+{
+	if (chip.ack) {
+		chip.ack = false;
+		return CTS;
+	}
+
+	return chip.busy ? chip.status & ~CTS : chip.status | CTS;
+}
+
+void
+model_select (void)
+{
+	chip.prefix = 0;
+	chip.pos    = 0;
+}
+
+void
+model_deselect (void)
+{
+	chip.prefix = 0;
+}
+
+// Clock one byte in and out of the chip.
+uint8_t
+model_xfer (const uint8_t out)
+{
+	advance();
+
+	if (chip.prefix == 0) {
+		chip.prefix = out;
+		chip.pos    = 0;
+		return 0x00;
+	}
+
+	switch (chip.prefix) {
+	case CMD_WRITE:
+		if (chip.pos < sizeof (chip.frame)) {
+			chip.frame[chip.pos++] = out;
+
+			if (chip.pos == sizeof (chip.frame))
+				execute(chip.frame);
+		}
+		return 0x00;
+
+	case CMD_READ_SHORT:
+		return status();
+
+	case CMD_READ_LONG:
+		if (chip.pos == 0) {
+			chip.pos++;
+			return status();
+		}
+		return chip.pos < sizeof (chip.resp) ? chip.resp[chip.pos++] : 0x00;
+	}
+
+	return 0x00;
+}
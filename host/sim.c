@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+#include "host.h"
+
+// I/O registers.
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+volatile uint8_t TIFR0, TIFR1, TIFR2;
+volatile uint8_t EIFR, EIMSK, EICRA;
+volatile uint8_t GPIOR0, GPIOR1, GPIOR2;
+volatile uint8_t SPCR, SPSR, SPDR;
+volatile uint8_t SREG, MCUSR, PRR;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0;
+volatile uint16_t TCNT1, OCR1A, OCR1B, UBRR0;
+
+// Interrupt handlers, if the firmware defines them.
+extern void INT0_vect (void) __attribute__((weak));
+
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+
+static bool realtime;
+
+// Virtual time in fast mode.
+static uint64_t now;
+
+// Wall clock time at startup, for real-time mode.
+static struct timespec epoch;
+
+__attribute__((constructor))
+static void
+init (void)
+{
+	const char *mode = getenv("RADIUNO_TIME");
+
+	// Follow the wall clock when someone is typing, else run as fast as
+	// possible. Can be overridden with RADIUNO_TIME=real or fast.
+	realtime = mode
+		? strcmp(mode, "real") == 0
+		: isatty(0) || getenv("RADIUNO_PTY");
+
+	clock_gettime(CLOCK_MONOTONIC, &epoch);
+}
+
+bool
+host_realtime (void)
+{
+	return realtime;
+}
+
+uint64_t
+host_now (void)
+{
+	struct timespec ts;
+
+	if (!realtime)
+		return now;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec - epoch.tv_sec) * 1000000ULL
+	     + (ts.tv_nsec - epoch.tv_nsec) / 1000;
+}
+
+// Let time pass with interrupts held off, like a run of instructions.
+void
+host_busy (const uint64_t us)
+{
+	if (!realtime) {
+		now += us;
+		return;
+	}
+
+	const uint64_t until = host_now() + us;
+
+	while (host_now() < until)
+		continue;
+}
+
+// Busy wait, servicing interrupts as they come due.
+void
+host_delay (const uint64_t us)
+{
+	host_busy(us);
+	host_irq();
+}
+
+// Run the interrupt handlers of all events that came due, if interrupts
+// are enabled.
+void
+host_irq (void)
+{
+	if (!(SREG & 0x80))
+		return;
+
+	host_uart_run();
+	host_clock_run();
+
+	if (model_run() && (EIMSK & _BV(INT0)) && INT0_vect)
+		INT0_vect();
+}
+
+// Wait for the next event, the given deadline or console input, whichever
+// comes first.
+void
+host_idle (const uint64_t until)
+{
+	uint64_t next = until;
+
+	next = MIN(next, host_clock_next());
+	next = MIN(next, model_next());
+	next = MIN(next, host_uart_next());
+
+	// New input is handled before anything else happens.
+	if (host_uart_wait(next)) {
+		host_irq();
+		return;
+	}
+
+	// With no event pending and no input to come, the firmware would
+	// sleep forever.
+	if (next == HOST_NEVER) {
+		fprintf(stderr, "radiuno: stalled, nothing left to wait for\n");
+		exit(1);
+	}
+
+	if (!realtime && next > now)
+		now = next;
+
+	host_irq();
+}
+
+// Called by sleep_cpu().
+void
+host_sleep (void)
+{
+	host_idle(HOST_NEVER);
+}
@@ -0,0 +1,76 @@
+#include <stddef.h>
+
+#include "../src/clock.h"
+#include "../src/probe.h"
+#include "../src/spi.h"
+#include "host.h"
+
+// Same settle time as src/spi.c.
+#ifndef SPI_SELECT_DELAY_US
+#define SPI_SELECT_DELAY_US	100
+#endif
+
+// Whether the slave is currently selected.
+static bool selected;
+
+void
+spi_init (void)
+{
+}
+
+// Clock the transaction through the si4735 model at once, taking as much
+// simulated time as the bytes would take on the bus.
+void
+spi_submit (struct spi_xfer *x)
+{
+	const uint8_t size = x->PREFIX + x->len + x->fill;
+
+	x->busy = true;
+
+	if (!selected) {
+		model_select();
+		selected = true;
+		host_busy(SPI_SELECT_DELAY_US);
+	}
+
+	x->start = clock_now();
+
+	for (uint8_t i = 0; i < size; i++) {
+		const uint8_t j = i - x->PREFIX;
+		uint8_t out;
+
+		if (x->PREFIX && i == 0)
+			out = x->prefix;
+		else
+			out = (x->tx && j < x->len) ? x->tx[j] : 0x00;
+
+		host_busy(SPI_BYTE_US);
+
+		const uint8_t in = model_xfer(out);
+
+		if (x->rx && !(x->PREFIX && i == 0) && j < x->len)
+			x->rx[j] = in;
+	}
+
+	if (!x->HOLD) {
+		model_deselect();
+		selected = false;
+	}
+
+	x->ticks = clock_now() - x->start;
+	x->busy  = false;
+
+	PROBE_RECORD(SPI, x->ticks);
+
+	if (x->on_done)
+		x->on_done(x);
+
+	host_irq();
+}
+
+// Transactions complete as soon as they are submitted.
+void
+spi_wait (const struct spi_xfer *x)
+{
+	(void) x;
+}
@@ -0,0 +1,520 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "../src/format.h"
+#include "../src/uart.h"
+#include "host.h"
+
+// Same defaults and FIFO sizes as src/uart.c.
+#ifndef BAUD
+#define BAUD		115200UL
+#endif
+
+#ifndef BAUD_TOL
+#define BAUD_TOL	25
+#endif
+
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE	64
+#endif
+
+#ifndef UART_RX_SIZE
+#define UART_RX_SIZE	64
+#endif
+
+#define RX_MASK		(UART_RX_SIZE - 1)
+#define RX_HIGH		(UART_RX_SIZE * 3 / 4)
+
+// Ctrl-], quits when typing on a terminal.
+#define KEY_QUIT	0x1D
+
+// Receive FIFO, filled by receive() as the Rx interrupt would.
+static struct {
+	uint8_t fifo[UART_RX_SIZE];
+	uint8_t head;
+	uint8_t tail;
+} rx;
+
+// Console input that was read but not yet received by the firmware. The
+// host side acts as a sender that honors flow control, pausing when the Rx
+// FIFO reaches its high watermark, so scripted input is never dropped.
+// Without flow control, it sends at line rate and the FIFO can overflow.
+static struct {
+	uint8_t buf[256];
+	uint16_t pos;
+	uint16_t len;
+	bool     eof;
+	bool     cr;	// Last byte was a carriage return
+} in;
+
+// File descriptors of the console.
+static int fd_in  = 0;
+static int fd_out = 1;
+
+// Whether the console is a terminal, and its settings before we changed them.
+static bool tty;
+static struct termios saved;
+
+// Pause after each line of input, in microseconds.
+static uint64_t line_us;
+
+// Time the next input byte arrives, and the time the transmitter goes idle.
+static uint64_t rx_next;
+static uint64_t tx_done;
+
+static uint32_t baud = BAUD;
+static bool raw;
+static bool mute;
+static bool flag_etx;
+static bool throttled;
+static bool flow = true;
+static struct uart_stats stats;
+static void (* on_idle) (void);
+
+// Time on the wire for one byte of ten bits, in microseconds.
+static uint64_t
+byte_us (void)
+{
+	return (10000000UL + baud - 1) / baud;
+}
+
+static uint8_t
+rx_used (void)
+{
+	return (rx.head - rx.tail) & RX_MASK;
+}
+
+// Handle a received byte like the Rx interrupt handler does.
+static void
+receive (const uint8_t c)
+{
+	if (c == 0x03 && !raw) {
+		flag_etx = true;
+		return;
+	}
+
+	const uint8_t next = (rx.head + 1) & RX_MASK;
+	if (next == rx.tail) {
+		stats.dropped++;
+		return;
+	}
+
+	rx.fifo[rx.head] = c;
+	rx.head = next;
+}
+
+// Get the time of the next input byte, if the sender is not paused.
+uint64_t
+host_uart_next (void)
+{
+	if (in.pos == in.len || (flow && rx_used() >= RX_HIGH))
+		return HOST_NEVER;
+
+	return rx_next;
+}
+
+// Deliver the input bytes that have arrived by now.
+void
+host_uart_run (void)
+{
+	const uint64_t now = host_now();
+
+	while (in.pos < in.len && rx_next <= now) {
+		if (flow && rx_used() >= RX_HIGH) {
+			if (!throttled) {
+				throttled = true;
+				stats.throttled++;
+			}
+			rx_next = now;
+			return;
+		}
+
+		const uint8_t c = in.buf[in.pos++];
+
+		throttled = false;
+		rx_next  += byte_us();
+
+		if (c == '\r' || c == '\n')
+			rx_next += line_us;
+
+		receive(c);
+	}
+}
+
+// Filter input before it is sent to the firmware. When input does not come
+// from a terminal, lines end in a newline, which becomes the carriage
+// return that the Enter key sends; a newline after a carriage return is
+// dropped.
+static uint16_t
+filter (uint8_t *buf, const uint16_t len)
+{
+	uint16_t n = 0;
+
+	for (uint16_t i = 0; i < len; i++) {
+		const uint8_t c = buf[i];
+
+		if (tty && c == KEY_QUIT)
+			exit(0);
+
+		if (!tty && c == '\n') {
+			if (!in.cr)
+				buf[n++] = '\r';
+		} else
+			buf[n++] = c;
+
+		in.cr = (c == '\r');
+	}
+
+	return n;
+}
+
+// Wait for console input until the given time. Returns true if input or
+// end of file arrived, false on timeout.
+bool
+host_uart_wait (const uint64_t until)
+{
+	struct pollfd pfd = { .fd = fd_in, .events = POLLIN };
+	const uint64_t now = host_now();
+	int timeout;
+
+	// In fast mode, only block when there is nothing else to wait for.
+	if (until == HOST_NEVER)
+		timeout = -1;
+	else if (!host_realtime() || until <= now)
+		timeout = 0;
+	else
+		timeout = (until - now + 999) / 1000;
+
+	// Don't read ahead while the sender has pending bytes.
+	if (in.eof || in.pos < in.len) {
+		if (timeout > 0)
+			usleep((until - now));
+		return false;
+	}
+
+	if (poll(&pfd, 1, timeout) <= 0)
+		return false;
+
+	const ssize_t n = read(fd_in, in.buf, sizeof (in.buf));
+
+	// A pseudo-terminal without a client reads as an I/O error.
+	if (n < 0 && (errno == EIO || errno == EAGAIN || errno == EINTR)) {
+		if (timeout > 0)
+			usleep(timeout * 1000);
+		return false;
+	}
+
+	if (n <= 0) {
+		in.eof = true;
+		return true;
+	}
+
+	in.pos = 0;
+	in.len = filter(in.buf, n);
+
+	if (rx_next < now)
+		rx_next = now + byte_us();
+
+	return true;
+}
+
+// Write to the console. Output to a pseudo-terminal is dropped when nobody
+// reads it, as on a serial line.
+static void
+output (const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len > 0) {
+		const ssize_t n = write(fd_out, p, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+
+		p   += n;
+		len -= n;
+	}
+}
+
+static void
+restore (void)
+{
+	if (tty)
+		tcsetattr(fd_in, TCSAFLUSH, &saved);
+}
+
+// Open a pseudo-terminal for a terminal program to connect to.
+static void
+open_pty (void)
+{
+	struct termios t;
+	const int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (fd < 0 || grantpt(fd) || unlockpt(fd)) {
+		perror("radiuno: pty");
+		exit(1);
+	}
+
+	tcgetattr(fd, &t);
+	cfmakeraw(&t);
+	tcsetattr(fd, TCSANOW, &t);
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	fprintf(stderr, "radiuno: console on %s\n", ptsname(fd));
+	fd_in = fd_out = fd;
+}
+
+void
+uart_init (void)
+{
+	const char *line_ms = getenv("RADIUNO_LINE_MS");
+	const char *mode    = getenv("RADIUNO_FLOW");
+
+	if (line_ms)
+		line_us = strtoul(line_ms, NULL, 10) * 1000;
+
+	if (mode)
+		flow = strcmp(mode, "none") != 0;
+
+	if (getenv("RADIUNO_PTY")) {
+		open_pty();
+		return;
+	}
+
+	// On a terminal, pass every key to the firmware, including Ctrl-C.
+	if ((tty = isatty(fd_in))) {
+		struct termios t;
+
+		tcgetattr(fd_in, &saved);
+		t = saved;
+		cfmakeraw(&t);
+		tcsetattr(fd_in, TCSAFLUSH, &t);
+		atexit(restore);
+
+		fprintf(stderr, "radiuno: press Ctrl-] to quit\r\n");
+	}
+}
+
+// Return the next character in the Rx FIFO; may block. Exits when the
+// console input ends.
+uint8_t
+uart_getchar (void)
+{
+	for (;;) {
+		if (on_idle)
+			on_idle();
+
+		cli();
+
+		if (rx.head != rx.tail) {
+			const uint8_t c = rx.fifo[rx.tail];
+			rx.tail = (rx.tail + 1) & RX_MASK;
+			sei();
+			return c;
+		}
+
+		if (in.eof && in.pos == in.len) {
+			uart_flush();
+			exit(0);
+		}
+
+		sei();
+		sleep_cpu();
+	}
+}
+
+void
+uart_idle (void (* fn) (void))
+{
+	on_idle = fn;
+}
+
+void
+uart_raw (const bool on)
+{
+	raw = on;
+}
+
+void
+uart_mute (const bool on)
+{
+	mute = on;
+}
+
+bool
+uart_flag_etx (void)
+{
+	if (flag_etx) {
+		flag_etx = false;
+		return true;
+	}
+	return false;
+}
+
+void
+uart_stats_get (struct uart_stats *s)
+{
+	*s = stats;
+}
+
+void
+uart_stats_reset (void)
+{
+	stats = (struct uart_stats) { 0 };
+}
+
+// Bytes still in the transmitter at the given time.
+static uint64_t
+tx_used (const uint64_t now)
+{
+	return tx_done > now ? (tx_done - now + byte_us() - 1) / byte_us() : 0;
+}
+
+uint8_t
+uart_tx_free (void)
+{
+	const uint64_t used = tx_used(host_now());
+
+	return used < UART_TX_SIZE - 1 ? UART_TX_SIZE - 1 - used : 0;
+}
+
+// The bytes go out to the console at once, but take their time on the
+// simulated wire, so that the firmware sees the same back pressure.
+uint8_t
+uart_try_write (const void *buf, uint8_t len)
+{
+	const uint64_t now = host_now();
+	const uint8_t free = uart_tx_free();
+
+	if (mute)
+		return len;
+
+	if (len > free)
+		len = free;
+
+	if (len == 0)
+		return 0;
+
+	output(buf, len);
+
+	tx_done = (tx_done > now ? tx_done : now) + len * byte_us();
+	return len;
+}
+
+void
+uart_write (const void *buf, uint8_t len)
+{
+	const uint8_t *src = buf;
+
+	for (;;) {
+		const uint8_t n = uart_try_write(src, len);
+
+		if ((len -= n) == 0)
+			return;
+
+		src += n;
+
+		// Sleep until the next byte has left.
+		host_idle(host_now() + byte_us());
+	}
+}
+
+void
+uart_flush (void)
+{
+	while (host_now() < tx_done)
+		host_idle(tx_done);
+}
+
+bool
+uart_baud_ok (const uint32_t rate)
+{
+	if (rate == 0 || rate > F_CPU / 8)
+		return false;
+
+	// Same divisor search as the firmware, in normal and double speed.
+	for (uint32_t div = 16; div >= 8; div -= 8) {
+		const uint32_t ubrr = (F_CPU + div / 2 * rate) / (div * rate) - 1;
+		const uint32_t real = F_CPU / (div * (ubrr + 1));
+		const uint32_t err  = (real > rate ? real - rate : rate - real) * 1000 / rate;
+
+		if (ubrr <= 0x0FFF && err <= BAUD_TOL)
+			return true;
+	}
+
+	return false;
+}
+
+uint32_t
+uart_baud (void)
+{
+	return baud;
+}
+
+bool
+uart_baud_set (const uint32_t rate)
+{
+	if (!uart_baud_ok(rate))
+		return false;
+
+	uart_flush();
+	baud = rate;
+	return true;
+}
+
+bool
+uart_rx_ready (void)
+{
+	return rx.head != rx.tail;
+}
+
+void
+uart_putc (const uint8_t c)
+{
+	uart_write(&c, 1);
+}
+
+static void
+emit (const char *buf, uint8_t len)
+{
+	uart_write(buf, len);
+}
+
+void
+uart_printf (const char *restrict fmt, ...)
+{
+	va_list argp;
+
+	if (!fmt || mute)
+		return;
+
+	va_start(argp, fmt);
+	format(emit, true, fmt, argp);
+	va_end(argp);
+}
+
+void
+uart_printf_P (const char *restrict fmt, ...)
+{
+	va_list argp;
+
+	if (!fmt || mute)
+		return;
+
+	va_start(argp, fmt);
+	format(emit, false, fmt, argp);
+	va_end(argp);
+}
@@ -3,11 +3,13 @@
 #include <avr/pgmspace.h>
 
 #include "args.h"
+#include "probe.h"
 
 struct args *
 args_parse (char *line, struct args *args)
 {
 	static const char PROGMEM whitespace[] = " \t\f\v";
+	PROBE_SCOPE(ARGS_PARSE);
 
 	args->ac = 0;
 
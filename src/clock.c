@@ -0,0 +1,227 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#include "clock.h"
+#include "timer.h"
+
+// Length of a counter period in microseconds.
+#define PERIOD_US	CLOCK_TICKS_US(0x10000UL)
+
+// Number of Timer1 overflows, the upper half of the 32-bit clock.
+static volatile uint32_t overflows;
+
+// Milliseconds at the last overflow, and the microseconds past that.
+static volatile uint32_t millis;
+static volatile uint16_t millis_us;
+
+// Time of the pending alarm, and whether it is set.
+static volatile uint32_t alarm;
+static volatile bool alarm_set;
+
+// Arm the compare match for the alarm if it falls within a counter period.
+// Times that are very close or past are moved out a bit, because a compare
+// value that the counter has already passed would not match until it wraps.
+static void
+alarm_arm (const uint32_t now)
+{
+	int32_t left = alarm - now;
+
+	if (left > 0xFFFF)
+		return;
+
+	if (left < (int32_t) CLOCK_US_TICKS(10))
+		left = CLOCK_US_TICKS(10);
+
+	OCR1B   = now + left;
+	TIFR1   = _BV(OCF1B);
+	TIMSK1 |= _BV(OCIE1B);
+}
+
+ISR (TIMER1_OVF_vect)
+{
+	overflows++;
+
+	millis    += PERIOD_US / 1000;
+	millis_us += PERIOD_US % 1000;
+
+	if (millis_us >= 1000) {
+		millis_us -= 1000;
+		millis++;
+	}
+
+	// Arm the alarm once it comes within range.
+	if (alarm_set && !(TIMSK1 & _BV(OCIE1B)))
+		alarm_arm(clock_now32());
+}
+
+// The compare match A only serves to wake the CPU, and is a one-shot.
+ISR (TIMER1_COMPA_vect)
+{
+	TIMSK1 &= ~_BV(OCIE1A);
+}
+
+// The compare match B is the alarm. Runs the software timers, which set the
+// next alarm.
+ISR (TIMER1_COMPB_vect)
+{
+	TIMSK1   &= ~_BV(OCIE1B);
+	alarm_set = false;
+	timer_run();
+}
+
+// Return the lower 16 bits of the clock. Reading TCNT1 goes through a shared
+// temporary register, so the read must not be interrupted by an ISR that
+// also reads it.
+uint16_t
+clock_now (void)
+{
+	uint16_t now;
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+		now = TCNT1;
+
+	return now;
+}
+
+// Read the counter and the overflow count together. If the counter wrapped
+// but the overflow interrupt has not run yet, account for it here.
+static inline uint16_t
+read (uint32_t *hi)
+{
+	const uint16_t lo = TCNT1;
+
+	*hi = overflows;
+
+	if ((TIFR1 & _BV(TOV1)) && lo < 0x8000)
+		(*hi)++;
+
+	return lo;
+}
+
+// Return the full 32-bit clock.
+uint32_t
+clock_now32 (void)
+{
+	uint32_t hi;
+	uint16_t lo;
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+		lo = read(&hi);
+
+	return hi << 16 | lo;
+}
+
+// Return the microseconds since reset.
+uint32_t
+clock_micros (void)
+{
+	uint32_t hi;
+	uint16_t lo;
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+		lo = read(&hi);
+
+	return hi * PERIOD_US + CLOCK_TICKS_US(lo);
+}
+
+// Return the milliseconds since reset.
+uint32_t
+clock_millis (void)
+{
+	uint32_t ms, hi;
+	uint16_t lo, us;
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		lo = read(&hi);
+		ms = millis;
+		us = millis_us;
+
+		// A pending overflow has not been added yet.
+		if (hi != overflows) {
+			ms += PERIOD_US / 1000;
+			us += PERIOD_US % 1000;
+		}
+	}
+
+	return ms + (us + CLOCK_TICKS_US((uint32_t) lo)) / 1000;
+}
+
+// Sleep until the given time, or until woken by another interrupt. Returns
+// true once the time has been reached.
+bool
+clock_sleep (const uint32_t until)
+{
+	cli();
+
+	const int32_t left = until - clock_now32();
+
+	// Spin instead of sleeping if the time is very close, because the
+	// compare match could be missed.
+	if (left < (int32_t) CLOCK_US_TICKS(10)) {
+		sei();
+		return left <= 0;
+	}
+
+	// Times more than a counter period away need no alarm: the overflow
+	// interrupt will wake the CPU in time to set one.
+	if (left <= 0xFFFF) {
+		OCR1A   = until;
+		TIFR1   = _BV(OCF1A);
+		TIMSK1 |= _BV(OCIE1A);
+	}
+
+	// Sleep until woken by an interrupt.
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+
+	return false;
+}
+
+// Sleep for the given number of microseconds, servicing interrupts.
+void
+clock_delay (const uint32_t us)
+{
+	const uint32_t until = clock_now32() + CLOCK_US_TICKS(us);
+
+	while (!clock_sleep(until))
+		continue;
+}
+
+// Set the alarm, replacing the previous one. Called with interrupts
+// disabled.
+void
+clock_alarm (const uint32_t when)
+{
+	TIMSK1   &= ~_BV(OCIE1B);
+	alarm     = when;
+	alarm_set = true;
+	alarm_arm(clock_now32());
+}
+
+// Clear the alarm. Called with interrupts disabled.
+void
+clock_alarm_off (void)
+{
+	TIMSK1   &= ~_BV(OCIE1B);
+	alarm_set = false;
+}
+
+void
+clock_init (void)
+{
+	// Wake up Timer1:
+	PRR &= ~_BV(PRTIM1);
+
+	// Normal mode, count from zero at F_CPU/8:
+	TCCR1A = 0;
+	TCNT1  = 0;
+	TCCR1B = _BV(CS11);
+
+	// Enable overflow interrupt:
+	TIMSK1 = _BV(TOIE1);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Timer1 runs freely at F_CPU/8, giving a resolution of half a microsecond at
+// 16 MHz. The 16-bit counter wraps every 32 ms; overflows are counted in
+// software to extend it to 32 bits for longer intervals. It is the system
+// tick: clock_micros() and clock_millis() count from reset, and wrap after
+// 71 minutes and 49 days respectively. The compare match B unit serves as
+// the alarm of the software timers in timer.c.
+#define CLOCK_PRESCALE	8UL
+#define CLOCK_HZ	(F_CPU / CLOCK_PRESCALE)
+
+// Convert between clock ticks and microseconds.
+#define CLOCK_TICKS_US(t)	((t) / (CLOCK_HZ / 1000000UL))
+#define CLOCK_US_TICKS(us)	((us) * (CLOCK_HZ / 1000000UL))
+
+extern void     clock_init (void);
+extern uint16_t clock_now (void);
+extern uint32_t clock_now32 (void);
+extern uint32_t clock_micros (void);
+extern uint32_t clock_millis (void);
+extern bool     clock_sleep (const uint32_t until);
+extern void     clock_delay (const uint32_t us);
+extern void     clock_alarm (const uint32_t when);
+extern void     clock_alarm_off (void);
@@ -2,6 +2,9 @@
 #include <avr/pgmspace.h>
 
 #include "cmd.h"
+#include "preset.h"
+#include "probe.h"
+#include "si4735_cmd.h"
 #include "uart.h"
 #include "version.h"
 
@@ -11,7 +14,9 @@
 extern uint8_t _binary_src_banner_txt_start;
 extern uint8_t _binary_src_banner_txt_end;
 
-struct cmd *cmd_list = NULL;
+// Zero-sized markers in sections that sort before and after all commands.
+const struct cmd cmd_table[0]     __attribute__((used, section(".progmem.cmd.!")));
+const struct cmd cmd_table_end[0] __attribute__((used, section(".progmem.cmd.~")));
 
 static struct cmd_state state = {
 	.band = CMD_BAND_NONE,
@@ -20,39 +25,107 @@ static struct cmd_state state = {
 void
 cmd_print_help (const char *cmd, const void *map, const uint8_t count, const uint8_t stride)
 {
-	static const char PROGMEM p1[] = "%s [";
+	static const char PROGMEM p1[] = "%p [";
 	static const char PROGMEM p2[] = "%s %p ";
 	static const char PROGMEM p3[] = "]\n";
+	const uint8_t *p = map;
 
 	uart_printf_P(p1, cmd);
-	for (uint8_t i = 0; i < count; map += stride, i++)
-		uart_printf_P(p2, i ? "|" : "", *(const char **) map);
+	for (uint8_t i = 0; i < count; p += stride, i++)
+		uart_printf_P(p2, i ? "|" : "", *(const char **) p);
 	uart_printf_P(p3);
 }
 
-void
-cmd_link (struct cmd *cmd)
+static bool
+power_up (const enum cmd_band band)
 {
-	struct cmd *c;
-
-	// If this is the first command to register itself, or if it sorts
-	// below the current list head, then insert it at the front.
-	if (cmd_list == NULL || strcasecmp(cmd->name, cmd_list->name) < 0) {
-		cmd->next = cmd_list;
-		cmd_list  = cmd;
-		return;
+	switch (band) {
+	case CMD_BAND_AM:
+	case CMD_BAND_SW:
+	case CMD_BAND_LW: return si4735_am_power_up();
+	case CMD_BAND_FM: return si4735_fm_power_up();
+	default         : return false;
 	}
+}
+
+// Switch to the given band, powering the chip down and up again.
+bool
+cmd_band_set (struct cmd_state *state, const enum cmd_band band)
+{
+	// If already in the desired band, ignore.
+	if (state->band == band)
+		return true;
+
+	// Power down the chip if not already down.
+	if (state->band != CMD_BAND_NONE)
+		if (!si4735_power_down())
+			return false;
+
+	state->band = CMD_BAND_NONE;
+
+	// Power up the chip in the new mode.
+	if (!power_up(band))
+		return false;
+
+	// For SW and LW, set non-default band limits.
+	if (band == CMD_BAND_SW) {
+		si4735_prop_set(SI4735_PROP_AM_SEEK_BAND_BOTTOM, 1711);
+		si4735_prop_set(SI4735_PROP_AM_SEEK_BAND_TOP, 27000);
+	}
+
+	if (band == CMD_BAND_LW) {
+		si4735_prop_set(SI4735_PROP_AM_SEEK_BAND_BOTTOM, 153);
+		si4735_prop_set(SI4735_PROP_AM_SEEK_BAND_TOP, 279);
+		si4735_prop_set(SI4735_PROP_AM_SEEK_FREQ_SPACING, 9);
+	}
+
+	state->tune.freq = 0;
+	state->band = band;
+	return true;
+}
+
+// Tune to the given frequency and wait for the chip to settle.
+bool
+cmd_tune (struct cmd_state *state, const uint16_t freq)
+{
+	if (!si4735_freq_set(freq, false, false, state->band == CMD_BAND_SW))
+		return false;
+
+	// If the command was successful, sleep until STCINT becomes set,
+	// to indicate that the chip has settled on a frequency.
+	if (!si4735_stc_wait())
+		return false;
 
-	// Walk the linked list to find either the last element, or the element
-	// whose next element sorts above this command. This yields the element
-	// after which the command should be inserted.
-	for (c = cmd_list; c->next != NULL; c = c->next)
-		if (strcasecmp(c->next->name, cmd->name) > 0)
-			break;
+	return si4735_tune_status(&state->tune);
+}
+
+// Copy a command table entry from flash.
+void
+cmd_load (const struct cmd *cmd, struct cmd *buf)
+{
+	memcpy_P(buf, cmd, sizeof (*buf));
+}
+
+// Find a command by binary search through the sorted table.
+const struct cmd *
+cmd_find (const char *name)
+{
+	uint8_t lo = 0, hi = cmd_table_end - cmd_table;
+
+	while (lo < hi) {
+		const uint8_t mid = (lo + hi) / 2;
+		const int cmp = strcasecmp_P(name, pgm_read_ptr(&cmd_table[mid].name));
+
+		if (cmp == 0)
+			return &cmd_table[mid];
 
-	// Insert the given command structure at this location.
-	cmd->next = c->next;
-	c->next   = cmd;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
 }
 
 static void
@@ -73,38 +146,197 @@ prompt (void)
 		[CMD_BAND_LW] = "lw %u > ",
 	};
 
-	(si4735_tune_status(&state.tune) && state.tune.freq)
+	(si4735_tune_status_cached(&state.tune) && state.tune.freq)
 		? uart_printf_P(prompt_freq[state.band], state.tune.freq)
 		: uart_printf_P(prompt_none[state.band]);
 }
 
+// Find the first table entry that starts with the given prefix. Prefix
+// matches are contiguous in the sorted table.
+static const struct cmd *
+cmd_lower (const char *prefix, const uint8_t len)
+{
+	uint8_t lo = 0, hi = cmd_table_end - cmd_table;
+
+	while (lo < hi) {
+		const uint8_t mid = (lo + hi) / 2;
+
+		if (strncasecmp_P(prefix, pgm_read_ptr(&cmd_table[mid].name), len) > 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return &cmd_table[lo];
+}
+
+// Candidate iterator over the command table or a subcommand map. Returns
+// the PROGMEM name of the next candidate that starts with the prefix.
+struct candidates {
+	const char    *prefix;
+	uint8_t        len;
+	const uint8_t *map;	// NULL for the command table
+	uint8_t        count;
+	uint8_t        stride;
+	uint8_t        i;
+	const struct cmd *cmd;
+};
+
+static const char *
+candidate_next (struct candidates *c)
+{
+	const char *name;
+
+	// Commands: scan from the lower bound while the prefix matches.
+	if (c->map == NULL) {
+		if (c->cmd == cmd_table_end)
+			return NULL;
+
+		name = pgm_read_ptr(&c->cmd->name);
+		if (strncasecmp_P(c->prefix, name, c->len))
+			return NULL;
+
+		c->cmd++;
+		return name;
+	}
+
+	// Subcommands: the maps are short, so scan them whole.
+	while (c->i < c->count) {
+		name = *(const char **) (c->map + c->i++ * c->stride);
+		if (strncasecmp_P(c->prefix, name, c->len) == 0)
+			return name;
+	}
+
+	return NULL;
+}
+
+// Complete the word before the cursor, which is a command name or the name
+// of its subcommand. Writes the text to insert to buf and returns its
+// length. When asked to list, prints the candidates and a new prompt, and
+// returns -1; the caller then redraws the line.
+int8_t
+cmd_complete (const char *line, const uint8_t len, char *buf, const uint8_t size, const bool list)
+{
+	struct candidates c = { .map = NULL };
+	uint8_t start = len, words = 0;
+
+	// Find the start of the word, and the number of words before it.
+	while (start > 0 && line[start - 1] != ' ')
+		start--;
+
+	for (uint8_t i = 0; i < start; i++)
+		if (line[i] != ' ' && (i == 0 || line[i - 1] == ' '))
+			words++;
+
+	c.prefix = line + start;
+	c.len    = len - start;
+
+	if (words == 0)
+		c.cmd = cmd_lower(c.prefix, c.len);
+
+	// Look up the command for subcommand completion.
+	else if (words == 1) {
+		const struct cmd *found;
+		struct cmd cmd;
+		char name[12];
+		uint8_t i = 0, n = 0;
+
+		while (line[i] == ' ')
+			i++;
+
+		while (line[i] != ' ' && n < sizeof (name) - 1)
+			name[n++] = line[i++];
+
+		name[n] = '\0';
+
+		if ((found = cmd_find(name)) == NULL)
+			return 0;
+
+		cmd_load(found, &cmd);
+		if (cmd.map == NULL)
+			return 0;
+
+		c.map    = cmd.map;
+		c.count  = cmd.count;
+		c.stride = cmd.stride;
+	}
+	else
+		return 0;
+
+	const struct candidates first = c;
+	const char *name;
+	uint8_t common = 0, matches = 0;
+
+	// Find the longest common extension of all candidates.
+	while ((name = candidate_next(&c)) != NULL) {
+		if (matches++ == 0) {
+			for (name += c.len; common < size && (buf[common] = pgm_read_byte(name)); name++)
+				common++;
+
+			continue;
+		}
+
+		for (uint8_t i = 0; i < common; i++)
+			if (buf[i] != pgm_read_byte(name + c.len + i)) {
+				common = i;
+				break;
+			}
+	}
+
+	// A unique match is completed with a space.
+	if (matches == 1 && common < size)
+		buf[common++] = ' ';
+
+	if (!list || matches < 2)
+		return common;
+
+	// List the candidates on a line of their own.
+	c = first;
+	uart_printf("\n");
+	while ((name = candidate_next(&c)) != NULL)
+		uart_printf("%p  ", name);
+
+	uart_printf("\n");
+	prompt();
+	return -1;
+}
+
 static bool
 dispatch_cmd (const struct args *args)
 {
 	static const char PROGMEM failed[]  = "%s: failed\n";
 	static const char PROGMEM unknown[] = "%s: unknown command\n";
+	PROBE_SCOPE(DISPATCH);
 
 	// Allow empty lines.
 	if (!args->ac)
 		return true;
 
-	// Find the command in the linked list and call it.
-	for (const struct cmd *c = cmd_list; c; c = c->next) {
-		if (strcasecmp(args->av[0], c->name))
-			continue;
-
-		if (c->on_call(args, &state))
-			return true;
+	const struct cmd *c = cmd_find(args->av[0]);
+	struct cmd cmd;
 
-		uart_printf_P(failed, args->av[0]);
+	// Print an error message if the command was not found.
+	if (c == NULL) {
+		uart_printf_P(unknown, args->av[0]);
 		return false;
 	}
 
-	// Print an error message if the command was not found.
-	uart_printf_P(unknown, args->av[0]);
+	// Call the command.
+	cmd_load(c, &cmd);
+	if (cmd.on_call(args, &state))
+		return true;
+
+	uart_printf_P(failed, args->av[0]);
 	return false;
 }
 
+// Dispatch a command without printing a prompt.
+bool
+cmd_dispatch (const struct args *args)
+{
+	return dispatch_cmd(args);
+}
+
 // Parse a command line.
 bool
 cmd_exec (const struct args *args)
@@ -140,8 +372,12 @@ cmd_init (void)
 {
 	banner();
 
-	if (cmd_exec(&(struct args) { .ac = 2, .av = { "mode", "fm" } }))
-	       cmd_exec(&(struct args) { .ac = 2, .av = { "seek", "up" } });
+	// Recall the first preset if it is set. Otherwise, seek the first FM
+	// station.
+	if (preset_load(0, &(struct preset) { 0 }))
+		cmd_exec(&(struct args) { .ac = 3, .av = { "preset", "recall", "0" } });
+	else if (cmd_exec(&(struct args) { .ac = 2, .av = { "mode", "fm" } }))
+		cmd_exec(&(struct args) { .ac = 2, .av = { "seek", "up" } });
 
 	prompt();
 }
@@ -2,18 +2,44 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <avr/pgmspace.h>
 
 #include "args.h"
 #include "si4735.h"
+#include "util.h"
 
-#define CMD_REGISTER(CMD)			\
-	__attribute__((constructor, used))	\
-	static void				\
-	link_cmd (void)				\
-	{					\
-		cmd_link(CMD);			\
+// Place a command in the command table in flash. Every command goes into a
+// section of its own, named after the command. The linker sorts sections by
+// name, so the table is sorted by command name at build time. Command names
+// must be lowercase. Defines the PROGMEM string cmd_name for the module.
+#define CMD_REGISTER(NAME, ON_CALL, ON_HELP)				\
+	static const char PROGMEM cmd_name[] = #NAME;			\
+	static const struct cmd cmd_entry				\
+	__attribute__((used, section(".progmem.cmd." #NAME))) = {	\
+		.name    = cmd_name,					\
+		.on_call = ON_CALL,					\
+		.on_help = ON_HELP,					\
 	}
 
+// Like CMD_REGISTER, for commands with a subcommand map. The first member
+// of each map entry must be the subcommand name as a PROGMEM string. The
+// map is used for tab completion.
+#define CMD_REGISTER_MAP(NAME, ON_CALL, ON_HELP, MAP)			\
+	static const char PROGMEM cmd_name[] = #NAME;			\
+	static const struct cmd cmd_entry				\
+	__attribute__((used, section(".progmem.cmd." #NAME))) = {	\
+		.name    = cmd_name,					\
+		.on_call = ON_CALL,					\
+		.on_help = ON_HELP,					\
+		.map     = MAP,						\
+		.count   = NELEM(MAP),					\
+		.stride  = STRIDE(MAP),					\
+	}
+
+// Iterate over the command table in sorted order.
+#define CMD_FOREACH(iter) \
+	for (const struct cmd *iter = cmd_table; iter < cmd_table_end; iter++)
+
 // Operating band of the command layer. Useful to set band limits, print
 // prompts, etc. This differs from the si4735's chip mode, which has lower
 // granularity and is either FM or AM/SW/LW.
@@ -30,17 +56,26 @@ struct cmd_state {
 	struct si4735_tune_status tune;
 };
 
+// Command table entry, stored in flash.
 struct cmd {
-	struct cmd *next;
-	const char *name;
+	const char *name;	// PROGMEM string
 	bool (* on_call) (const struct args *args, struct cmd_state *state);
 	void (* on_help) (void);
+	const void *map;	// Subcommand map in RAM, or NULL
+	uint8_t count;		// Number of map entries
+	uint8_t stride;		// Size of a map entry
 };
 
-// Pointer to the first command in the linked list.
-extern struct cmd *cmd_list;
+// Bounds of the command table.
+extern const struct cmd cmd_table[];
+extern const struct cmd cmd_table_end[];
 
 extern void cmd_print_help (const char *cmd, const void *map, const uint8_t count, const uint8_t stride);
-extern void cmd_link (struct cmd *cmd);
+extern const struct cmd *cmd_find (const char *name);
+extern void cmd_load (const struct cmd *cmd, struct cmd *buf);
+extern bool cmd_band_set (struct cmd_state *state, const enum cmd_band band);
+extern bool cmd_tune (struct cmd_state *state, const uint16_t freq);
+extern int8_t cmd_complete (const char *line, const uint8_t len, char *buf, const uint8_t size, const bool list);
+extern bool cmd_dispatch (const struct args *args);
 extern bool cmd_exec (const struct args *args);
 extern void cmd_init (void);
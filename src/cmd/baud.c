@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+
+#include "../clock.h"
+#include "../cmd.h"
+#include "../uart.h"
+
+// Seconds to wait for the terminal to confirm a new baud rate.
+#define CONFIRM_S	10
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(baud, on_call, on_help);
+
+static void
+on_help (void)
+{
+	uart_printf("%p [ <rate> ]\n", cmd_name);
+}
+
+// Wait for Enter at the new rate. Garbage received while the terminal is
+// being switched over is discarded. Ctrl-C or a timeout cancels.
+static bool
+confirm (void)
+{
+	const uint32_t deadline = clock_now32() + CLOCK_US_TICKS(CONFIRM_S * 1000000UL);
+
+	uart_flag_etx();
+
+	for (;;) {
+		while (uart_rx_ready()) {
+			const uint8_t c = uart_getchar();
+
+			if (c == '\r' || c == '\n')
+				return true;
+		}
+
+		if (uart_flag_etx())
+			return false;
+
+		if (clock_sleep(deadline))
+			return false;
+	}
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	static const char PROGMEM fmt_switch[] =
+		"Switch the terminal to %lu baud and press Enter within %u seconds.\n";
+
+	static const char PROGMEM fmt_rate[] = "Baud: %lu\n";
+
+	(void) state;
+
+	if (args->ac < 2) {
+		uart_printf_P(fmt_rate, (unsigned long) uart_baud());
+		return true;
+	}
+
+	const uint32_t prev = uart_baud();
+	const uint32_t rate = strtoul(args->av[1], NULL, 10);
+
+	if (!uart_baud_ok(rate))
+		return false;
+
+	uart_printf_P(fmt_switch, (unsigned long) rate, CONFIRM_S);
+	uart_baud_set(rate);
+
+	// Fall back to the old rate if the terminal does not answer.
+	if (!confirm())
+		uart_baud_set(prev);
+
+	uart_printf_P(fmt_rate, (unsigned long) uart_baud());
+	return true;
+}
@@ -0,0 +1,25 @@
+#include "../cmd.h"
+#include "../proto.h"
+#include "../uart.h"
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(binary, on_call, on_help);
+
+static void
+on_help (void)
+{
+	uart_printf("%p\n", cmd_name);
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	(void) args;
+
+	// Serve framed binary requests until the host asks to return.
+	proto_run(state);
+	return true;
+}
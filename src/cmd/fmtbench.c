@@ -0,0 +1,217 @@
+#ifdef FORMAT_BENCH
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "../clock.h"
+#include "../cmd.h"
+#include "../format.h"
+#include "../uart.h"
+
+// Compare the cycle cost of the division-based formatter that this tree
+// used to have with the current one. Both write into a dummy sink, so the
+// numbers exclude UART time. Only built with FORMAT_BENCH=1.
+
+// Number of runs per sample.
+#define RUNS	100
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(fmtbench, on_call, on_help);
+
+static volatile char last;
+
+static void
+sink (const char c)
+{
+	last = c;
+}
+
+static void
+emit (const char *buf, uint8_t len)
+{
+	last = buf[len - 1];
+}
+
+// The previous implementation, kept as the baseline with two fixes: va_arg
+// reads the promoted types, and the leading digit search compares against
+// the value divided by the base, since 'div * 10' and 'div * 16' wrapped
+// around in 16 bits and never ended for large values.
+static void
+old_format (bool ram, const char *restrict format, va_list argp)
+{
+	static const char PROGMEM hex[] = "0123456789ABCDEF";
+	char c;
+
+	while ((c = (ram) ? *format++ : pgm_read_byte(format++)) != 0)
+	{
+		switch (c)
+		{
+		case '%':
+			switch ((ram) ? *format++ : pgm_read_byte(format++)) {
+			case 0:
+				break;
+
+			case '%':
+				sink('%');
+				break;
+
+			case 'c':
+				sink(va_arg(argp, int));
+				break;
+
+			case 'd': {
+				uint16_t div;
+				int16_t d = (int16_t) va_arg(argp, int);
+				if (d < 0) {
+					sink('-');
+					d = -d;
+				}
+				if (d == 0) {
+					sink('0');
+					break;
+				}
+				for (div = 1; div <= d / 10; div *= 10)
+					continue;
+
+				while (div) {
+					uint8_t digit = d / div;
+					d -= div * digit;
+					div /= 10;
+					sink('0' + digit);
+				}
+				break;
+			}
+
+			case 's': {
+				const char *s = va_arg(argp, char *);
+				while (*s)
+					sink(*s++);
+				break;
+			}
+
+			case 'p': {
+				const char *s = va_arg(argp, char *);
+				while (pgm_read_byte(s))
+					sink(pgm_read_byte(s++));
+				break;
+			}
+
+			case 'u': {
+				uint16_t div, u = (uint16_t) va_arg(argp, unsigned int);
+				if (u == 0) {
+					sink('0');
+					break;
+				}
+				for (div = 1; div <= u / 10; div *= 10)
+					continue;
+
+				while (div) {
+					uint8_t digit = u / div;
+					u -= div * digit;
+					div /= 10;
+					sink('0' + digit);
+				}
+				break;
+			}
+
+			case 'x': {
+				uint16_t div, x = (uint16_t) va_arg(argp, unsigned int);
+				if (x == 0) {
+					sink('0');
+					break;
+				}
+				for (div = 1; div <= x / 16; div *= 16)
+					continue;
+
+				while (div) {
+					uint8_t digit = x / div;
+					x -= div * digit;
+					div /= 16;
+					sink(pgm_read_byte(hex + digit));
+				}
+				break;
+			}
+			}
+			break;
+
+		case '\n':
+			sink('\r');
+			// Fallthrough
+
+		default:
+			sink(c);
+			break;
+		}
+	}
+}
+
+static void
+bench_old (const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	old_format(true, fmt, ap);
+	va_end(ap);
+}
+
+static void
+bench_new (const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	format(emit, true, fmt, ap);
+	va_end(ap);
+}
+
+static void
+report (const char *name, const uint32_t t_old, const uint32_t t_new)
+{
+	uart_printf_P(PSTR("%p:\t%lu\t%lu\n"), name,
+		t_old * CLOCK_PRESCALE / RUNS,
+		t_new * CLOCK_PRESCALE / RUNS);
+}
+
+#define BENCH(NAME, ...)						\
+	do {								\
+		const uint32_t t0 = clock_now32();			\
+		for (uint8_t i = 0; i < RUNS; i++)			\
+			bench_old(__VA_ARGS__);				\
+		const uint32_t t1 = clock_now32();			\
+		for (uint8_t i = 0; i < RUNS; i++)			\
+			bench_new(__VA_ARGS__);				\
+		const uint32_t t2 = clock_now32();			\
+		report(PSTR(NAME), t1 - t0, t2 - t1);			\
+	} while (0)
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	static const char PROGMEM station[] = "radiuno";
+
+	uart_printf_P(PSTR("cycles per call, old\tnew\n"));
+
+	BENCH("zero",    "%u", 0U);
+	BENCH("u5",      "%u", 65535U);
+	BENCH("d5",      "%d", -32767);
+	BENCH("x4",      "%x", 0xBEEFU);
+	BENCH("s",       "%s", "radiuno");
+	BENCH("p",       "%p", station);
+	BENCH("line",    "%u kHz, %u dBuV, %u dB\n", 10070U, 42U, 17U);
+
+	return true;
+}
+
+static void
+on_help (void)
+{
+	uart_printf("%p\n", cmd_name);
+}
+
+#endif	// FORMAT_BENCH
@@ -1,13 +1,16 @@
 #include "../cmd.h"
 #include "../uart.h"
 
-// Forward declaration.
-static struct cmd cmd;
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(help, on_call, on_help);
 
 static void
 on_help (void)
 {
-	uart_printf("%s\n", cmd.name);
+	uart_printf("%p\n", cmd_name);
 }
 
 static bool
@@ -16,16 +19,12 @@ on_call (const struct args *args, struct cmd_state *state)
 	(void) state;
 
 	// Call the help callback on all modules.
-	for (const struct cmd *c = cmd_list; c; c = c->next)
-		c->on_help();
+	CMD_FOREACH (c) {
+		struct cmd cmd;
+
+		cmd_load(c, &cmd);
+		cmd.on_help();
+	}
 
 	return true;
 }
-
-static struct cmd cmd = {
-	.name    = "help",
-	.on_call = on_call,
-	.on_help = on_help,
-};
-
-CMD_REGISTER(&cmd);
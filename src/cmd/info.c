@@ -3,8 +3,11 @@
 #include "../cmd.h"
 #include "../uart.h"
 
-// Forward declaration.
-static struct cmd cmd;
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(info, on_call, on_help);
 
 static const char PROGMEM str[] =
 	"flags      : %s%s%s\n"
@@ -22,7 +25,7 @@ static const char PROGMEM str_am[] =
 static void
 on_help (void)
 {
-	uart_printf("%s\n", cmd.name);
+	uart_printf("%p\n", cmd_name);
 }
 
 static bool
@@ -33,7 +36,7 @@ on_call (const struct args *args, struct cmd_state *state)
 		return false;
 
 	// Get tune status.
-	if (!si4735_tune_status(&state->tune))
+	if (!si4735_tune_status_cached(&state->tune))
 		return false;
 
 	// Print generic info.
@@ -52,11 +55,3 @@ on_call (const struct args *args, struct cmd_state *state)
 
 	return true;
 }
-
-static struct cmd cmd = {
-	.name    = "info",
-	.on_call = on_call,
-	.on_help = on_help,
-};
-
-CMD_REGISTER(&cmd);
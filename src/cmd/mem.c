@@ -0,0 +1,92 @@
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "../cmd.h"
+#include "../uart.h"
+
+// RAM usage. The RAM between the end of the static data and the top of the
+// stack is painted with a known byte at reset, before anything runs. The
+// stack grows down into it, so the painted bytes that are left bound the
+// deepest stack reached so far, interrupts included. A stack byte that
+// happens to hold the paint value makes the estimate a byte or so low.
+#define PAINT	0xC5
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(mem, on_call, on_help);
+
+// Section bounds from the linker script.
+extern uint8_t __data_start[], __data_end[];
+extern uint8_t __bss_start[], __bss_end[];
+extern uint8_t __noinit_start[], __noinit_end[];
+extern uint8_t _end[], __stack[];
+
+static const char PROGMEM str[] =
+	"ram        : %u\n"
+	".data      : %u\n"
+	".bss       : %u\n"
+	".noinit    : %u\n"
+	"stack now  : %u\n"
+	"stack max  : %u\n"
+	"free       : %u\n";
+
+// Paint from the end of the static data up to the top of the stack. Runs
+// in .init1, before the stack pointer and the zero register are set up, so
+// it cannot be C.
+static void __attribute__((naked, used, section(".init1")))
+paint (void)
+{
+	__asm__ volatile (
+		"	ldi r30, lo8(_end)	\n"
+		"	ldi r31, hi8(_end)	\n"
+		"	ldi r24, %0		\n"
+		"	ldi r25, hi8(__stack)	\n"
+		"	rjmp 2f			\n"
+		"1:	st Z+, r24		\n"
+		"2:	cpi r30, lo8(__stack)	\n"
+		"	cpc r31, r25		\n"
+		"	brlo 1b			\n"
+		"	breq 1b			\n"
+		:: "M" (PAINT)
+	);
+}
+
+// Count the bytes above the static data that the stack never reached.
+static uint16_t
+unused (void)
+{
+	const uint8_t *p = _end;
+
+	while (p <= __stack && *p == PAINT)
+		p++;
+
+	return p - _end;
+}
+
+static void
+on_help (void)
+{
+	uart_printf("%p\n", cmd_name);
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	const uint16_t free = unused();
+
+	(void) args;
+	(void) state;
+
+	uart_printf_P(str,
+		RAMEND - RAMSTART + 1,
+		(uint16_t) (__data_end   - __data_start),
+		(uint16_t) (__bss_end    - __bss_start),
+		(uint16_t) (__noinit_end - __noinit_start),
+		(uint16_t) (RAMEND - SP),
+		(uint16_t) (__stack - _end + 1 - free),
+		free);
+
+	return true;
+}
@@ -4,8 +4,9 @@
 #include "../uart.h"
 #include "../util.h"
 
-// Forward declaration.
-static struct cmd cmd;
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
 
 static const char PROGMEM sub[][3] = {
 	"fm", "am", "sw", "lw"
@@ -23,10 +24,12 @@ map[] = {
 	{ sub[3], CMD_BAND_LW },
 };
 
+CMD_REGISTER_MAP(mode, on_call, on_help, map);
+
 static void
 on_help (void)
 {
-	cmd_print_help(cmd.name, map, NELEM(map), STRIDE(map));
+	cmd_print_help(cmd_name, map, NELEM(map), STRIDE(map));
 }
 
 static void
@@ -51,18 +54,6 @@ print_revision (void)
 		rev.patch_id);
 }
 
-static bool
-power_up (const enum cmd_band band)
-{
-	switch (band) {
-	case CMD_BAND_AM:
-	case CMD_BAND_SW:
-	case CMD_BAND_LW: return si4735_am_power_up();
-	case CMD_BAND_FM: return si4735_fm_power_up();
-	default         : return false;
-	}
-}
-
 static bool
 on_call (const struct args *args, struct cmd_state *state)
 {
@@ -81,36 +72,13 @@ on_call (const struct args *args, struct cmd_state *state)
 		if (state->band == m->band)
 			return true;
 
-		// Power down the chip if not already down.
-		if (state->band != CMD_BAND_NONE)
-			if (!si4735_power_down())
-				return false;
-
-		// Power up the chip in the new mode.
-		if (!power_up(m->band))
+		if (!cmd_band_set(state, m->band))
 			return false;
 
 		// Print chip revision data.
 		print_revision();
-
-		// For SW, set non-default band limits.
-		if (m->band == CMD_BAND_SW) {
-			si4735_prop_set(0x3400, 1711);
-			si4735_prop_set(0x3401, 27000);
-		}
-
-		state->tune.freq = 0;
-		state->band = m->band;
 		return true;
 	}
 
 	return false;
 }
-
-static struct cmd cmd = {
-	.name    = "mode",
-	.on_call = on_call,
-	.on_help = on_help,
-};
-
-CMD_REGISTER(&cmd);
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+
+#include "../cmd.h"
+#include "../preset.h"
+#include "../uart.h"
+#include "../util.h"
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+static const char PROGMEM sub[][7] = {
+	"store", "recall", "list"
+};
+
+static const char PROGMEM band_name[][3] = {
+	[CMD_BAND_FM] = "fm",
+	[CMD_BAND_AM] = "am",
+	[CMD_BAND_SW] = "sw",
+	[CMD_BAND_LW] = "lw",
+};
+
+static bool store  (const char *arg, struct cmd_state *state);
+static bool recall (const char *arg, struct cmd_state *state);
+static bool list   (const char *arg, struct cmd_state *state);
+
+// Subcommand map.
+static const struct {
+	const char *cmd;
+	bool (* on_call) (const char *arg, struct cmd_state *state);
+}
+map[] = {
+	{ sub[0], store  },
+	{ sub[1], recall },
+	{ sub[2], list   },
+};
+
+CMD_REGISTER_MAP(preset, on_call, on_help, map);
+
+static void
+on_help (void)
+{
+	cmd_print_help(cmd_name, map, NELEM(map), STRIDE(map));
+}
+
+// Parse a slot number.
+static bool
+parse_slot (const char *arg, uint8_t *slot)
+{
+	unsigned long n;
+
+	if (arg == NULL || *arg < '0' || *arg > '9')
+		return false;
+
+	// Range-check before narrowing, so that large numbers do not wrap
+	// around into a valid slot.
+	if ((n = strtoul(arg, NULL, 10)) >= PRESET_SLOTS)
+		return false;
+
+	*slot = n;
+	return true;
+}
+
+static bool
+store (const char *arg, struct cmd_state *state)
+{
+	uint8_t slot;
+
+	if (state->band == CMD_BAND_NONE || state->tune.freq == 0)
+		return false;
+
+	if (!parse_slot(arg, &slot))
+		return false;
+
+	return preset_store(slot, &(struct preset) {
+		.band = state->band,
+		.freq = state->tune.freq,
+	});
+}
+
+// Switch band if needed, and tune directly to the stored frequency.
+static bool
+recall (const char *arg, struct cmd_state *state)
+{
+	struct preset preset;
+	uint8_t slot;
+
+	if (!parse_slot(arg, &slot) || !preset_load(slot, &preset))
+		return false;
+
+	if (preset.band >= CMD_BAND_NONE)
+		return false;
+
+	if (!cmd_band_set(state, preset.band))
+		return false;
+
+	return cmd_tune(state, preset.freq);
+}
+
+static bool
+list (const char *arg, struct cmd_state *state)
+{
+	static const char PROGMEM fmt[] = "%u: %p %u\n";
+	struct preset preset;
+
+	(void) arg;
+	(void) state;
+
+	for (uint8_t i = 0; i < PRESET_SLOTS; i++)
+		if (preset_load(i, &preset) && preset.band < CMD_BAND_NONE)
+			uart_printf_P(fmt, i, band_name[preset.band], preset.freq);
+
+	return true;
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	// Handle insufficient args.
+	if (args->ac < 2) {
+		on_help();
+		return false;
+	}
+
+	// Handle subcommands.
+	FOREACH (map, m)
+		if (!strncasecmp_P(args->av[1], m->cmd, sizeof (*sub)))
+			return m->on_call(args->ac > 2 ? args->av[2] : NULL, state);
+
+	on_help();
+	return false;
+}
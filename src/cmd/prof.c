@@ -0,0 +1,165 @@
+#ifdef PROF
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "../cmd.h"
+#include "../uart.h"
+#include "../util.h"
+
+// Sampling profiler. Timer2 interrupts the program about a thousand times a
+// second, and the handler counts the interrupted program counter in a
+// histogram of equal address ranges that cover the program. Time spent
+// asleep shows up at the sleep instructions of the wait loops. Use
+// tools/prof.py to map a dump to function names.
+
+// Number of histogram buckets. The bucket size is the smallest power of two
+// that lets them cover the program, see range_init().
+#ifndef PROF_BUCKETS
+#define PROF_BUCKETS	192
+#endif
+
+// Timer2 runs at F_CPU/64 and interrupts on compare match. The period is
+// slightly off from a millisecond, so that it does not run in lockstep with
+// the code's own millisecond timing.
+#define PROF_OCR	(F_CPU / 64 / 1000 - 3)
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+static const char PROGMEM start[] = "start";
+static const char PROGMEM stop[]  = "stop";
+static const char PROGMEM dump[]  = "dump";
+
+static void prof_start (void);
+static void prof_stop  (void);
+static void prof_dump  (void);
+
+// Subcommand map.
+static const struct {
+	const char *cmd;
+	void (* on_call) (void);
+}
+map[] = {
+	{ start, prof_start },
+	{ stop,  prof_stop  },
+	{ dump,  prof_dump  },
+};
+
+CMD_REGISTER_MAP(prof, on_call, on_help, map);
+
+// End of the program code in flash, from the linker script.
+extern const uint8_t _etext[];
+
+static uint16_t hist[PROF_BUCKETS];
+
+// Samples that fell outside the histogram, and those lost to a full bucket.
+static uint16_t other;
+static uint16_t lost;
+
+// Log2 of the bucket size in bytes.
+static uint8_t shift;
+
+ISR (TIMER2_COMPA_vect)
+{
+	// The interrupted instruction, as a word address. The byte address
+	// of the upper half of the flash would not fit in a pointer.
+	const uint16_t pc = (uintptr_t) __builtin_return_address(0);
+	const uint16_t b = pc >> (shift - 1);
+
+	if (b >= PROF_BUCKETS)
+		other++;
+	else if (hist[b] < UINT16_MAX)
+		hist[b]++;
+	else
+		lost++;
+}
+
+// Pick the smallest bucket size that covers the program.
+static void
+range_init (void)
+{
+	for (shift = 1; ((uint16_t) (uintptr_t) _etext - 1) >> shift >= PROF_BUCKETS; shift++)
+		continue;
+}
+
+static void
+prof_start (void)
+{
+	range_init();
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		memset(hist, 0, sizeof (hist));
+		other = lost = 0;
+	}
+
+	// Wake up Timer2, clear timer on compare match at F_CPU/64:
+	PRR   &= ~_BV(PRTIM2);
+	TCCR2A = _BV(WGM21);
+	TCCR2B = _BV(CS22);
+	TCNT2  = 0;
+	OCR2A  = PROF_OCR;
+	TIFR2  = _BV(OCF2A);
+	TIMSK2 = _BV(OCIE2A);
+}
+
+static void
+prof_stop (void)
+{
+	TIMSK2 = 0;
+	TCCR2B = 0;
+	PRR   |= _BV(PRTIM2);
+}
+
+// Print the bucket size, the counts outside the histogram, and then the
+// start address in bytes and the count of every nonempty bucket.
+static void
+prof_dump (void)
+{
+	static const char PROGMEM head[] = "prof %u %u %u\n";
+	static const char PROGMEM row[]  = "%x %u\n";
+
+	uart_printf_P(head, 1U << shift, other, lost);
+
+	for (uint16_t b = 0; b < PROF_BUCKETS; b++) {
+		uint16_t n;
+
+		ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+			n = hist[b];
+
+		if (n)
+			uart_printf_P(row, b << shift, n);
+	}
+}
+
+static void
+on_help (void)
+{
+	cmd_print_help(cmd_name, map, NELEM(map), STRIDE(map));
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	(void) state;
+
+	if (args->ac < 2) {
+		on_help();
+		return false;
+	}
+
+	FOREACH (map, m)
+		if (!strcasecmp_P(args->av[1], m->cmd)) {
+			m->on_call();
+			return true;
+		}
+
+	on_help();
+	return false;
+}
+
+#endif
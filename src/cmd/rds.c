@@ -0,0 +1,40 @@
+#include <avr/pgmspace.h>
+
+#include "../cmd.h"
+#include "../rds.h"
+#include "../uart.h"
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(rds, on_call, on_help);
+
+static const char PROGMEM str[] =
+	"pi     : %x\n"
+	"pty    : %u\n"
+	"ps     : %s\n"
+	"text   : %s\n"
+	"groups : %u\n";
+
+static void
+on_help (void)
+{
+	uart_printf("%p\n", cmd_name);
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	// Only valid in FM mode.
+	if (state->band != CMD_BAND_FM)
+		return false;
+
+	// Catch up on pending groups.
+	rds_poll();
+
+	const struct rds *rds = rds_get();
+
+	uart_printf_P(str, rds->pi, rds->pty, rds->ps, rds->rt, rds->groups);
+	return true;
+}
@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "../clock.h"
+#include "../cmd.h"
+#include "../si4735_cmd.h"
+#include "../uart.h"
+
+// Maximum number of stations in the result table.
+#define SCAN_MAX	24
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(scan, on_call, on_help);
+
+static const char PROGMEM list[] = "list";
+
+// Packed result table of the last scan.
+static struct station {
+	uint16_t freq;
+	uint8_t  rssi;
+	uint8_t  snr;
+	uint8_t  mult;		// FM only
+} table[SCAN_MAX];
+
+static uint8_t       count;
+static enum cmd_band band = CMD_BAND_NONE;
+
+static void
+on_help (void)
+{
+	uart_printf("%p [ %p | <index> ]\n", cmd_name, list);
+}
+
+// Get the seek band limits and channel spacing from the chip. These are set
+// when changing bands.
+static bool
+band_limits (const struct cmd_state *state, uint16_t *lo, uint16_t *hi, uint16_t *step)
+{
+	if (state->band == CMD_BAND_FM)
+		return si4735_prop_get(SI4735_PROP_FM_SEEK_BAND_BOTTOM, lo)
+		    && si4735_prop_get(SI4735_PROP_FM_SEEK_BAND_TOP, hi)
+		    && si4735_prop_get(SI4735_PROP_FM_SEEK_FREQ_SPACING, step);
+
+	return si4735_prop_get(SI4735_PROP_AM_SEEK_BAND_BOTTOM, lo)
+	    && si4735_prop_get(SI4735_PROP_AM_SEEK_BAND_TOP, hi)
+	    && si4735_prop_get(SI4735_PROP_AM_SEEK_FREQ_SPACING, step);
+}
+
+// Add a station to the table. When the table is full, the weakest station
+// is dropped if the new one is stronger. Entries stay sorted by frequency.
+static void
+add_station (const uint16_t freq, const struct si4735_rsq_status *rsq)
+{
+	if (count == SCAN_MAX) {
+		uint8_t weakest = 0;
+
+		for (uint8_t i = 1; i < count; i++)
+			if (table[i].rssi < table[weakest].rssi)
+				weakest = i;
+
+		if (table[weakest].rssi >= rsq->rssi)
+			return;
+
+		memmove(&table[weakest], &table[weakest + 1],
+			(--count - weakest) * sizeof (*table));
+	}
+
+	table[count++] = (struct station) {
+		.freq = freq,
+		.rssi = rsq->rssi,
+		.snr  = rsq->snr,
+		.mult = (band == CMD_BAND_FM) ? rsq->fm.mult : 0,
+	};
+}
+
+static void
+print_table (void)
+{
+	static const char PROGMEM fmt[] =
+		"%u: %u, rssi: %u, snr: %u";
+
+	static const char PROGMEM fmt_fm[] =
+		", multipath: %u";
+
+	for (uint8_t i = 0; i < count; i++) {
+		uart_printf_P(fmt, i,
+			table[i].freq,
+			table[i].rssi,
+			table[i].snr);
+
+		// The chip only reports multipath in FM.
+		if (band == CMD_BAND_FM)
+			uart_printf_P(fmt_fm, table[i].mult);
+
+		uart_printf("\n");
+	}
+}
+
+// Fast-tune to a channel and measure the received signal quality. The fast
+// tune skips the chip's own validation.
+static bool
+measure (const uint16_t freq, const bool sw, struct si4735_rsq_status *rsq)
+{
+	if (!si4735_freq_set(freq, true, false, sw))
+		return false;
+
+	if (!si4735_stc_wait())
+		return false;
+
+	return si4735_rsq_status(rsq);
+}
+
+static bool
+scan (struct cmd_state *state)
+{
+	static const char PROGMEM fmt[] =
+		"\rScanned %u channels, %u.%u channels/s, %u stations\n";
+
+	struct si4735_rsq_status rsq;
+	uint16_t lo, hi, step, channels = 0;
+	const uint16_t orig = state->tune.freq;
+	const bool sw = state->band == CMD_BAND_SW;
+	bool ok = true;
+
+	if (!band_limits(state, &lo, &hi, &step) || step == 0)
+		return false;
+
+	count = 0;
+	band  = state->band;
+
+	// Clear the End-of-Text flag (Ctrl-C) by reading it.
+	uart_flag_etx();
+
+	const uint32_t start = clock_now32();
+
+	// Fast-tune to every channel in the band, and measure the received
+	// signal quality.
+	for (uint16_t freq = lo; freq <= hi; freq += step) {
+
+		// Quit on End-of-Text (Ctrl-C).
+		if (uart_flag_etx())
+			break;
+
+		if (!(ok = measure(freq, sw, &rsq)))
+			break;
+
+		if (rsq.VALID)
+			add_station(freq, &rsq);
+
+		// Show progress now and then.
+		if (++channels % 8 == 0)
+			uart_printf("\r%u ", freq);
+	}
+
+	// Report throughput in tenths of channels per second.
+	if (ok) {
+		const uint32_t ms   = CLOCK_TICKS_US(clock_now32() - start) / 1000;
+		const uint16_t rate = ms ? channels * 10000UL / ms : 0;
+
+		uart_printf_P(fmt, channels, rate / 10, rate % 10, count);
+		print_table();
+	}
+
+	// Return to the original frequency, also after an error.
+	if (orig && !cmd_tune(state, orig))
+		return false;
+
+	return ok;
+}
+
+static bool
+jump (struct cmd_state *state, const char *arg)
+{
+	const int i = atoi(arg);
+
+	// Only valid for a table entry from the current band.
+	if (band != state->band || i < 0 || i >= count)
+		return false;
+
+	// Zero is also what atoi() returns for garbage.
+	if (i == 0 && *arg != '0')
+		return false;
+
+	return cmd_tune(state, table[i].freq);
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	if (state->band == CMD_BAND_NONE)
+		return false;
+
+	if (args->ac < 2)
+		return scan(state);
+
+	if (!strncasecmp_P(args->av[1], list, sizeof (list))) {
+		print_table();
+		return true;
+	}
+
+	return jump(state, args->av[1]);
+}
@@ -2,17 +2,20 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
-#include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <avr/sleep.h>
 
 #include "../cmd.h"
+#include "../format.h"
+#include "../probe.h"
+#include "../timer.h"
 #include "../uart.h"
 #include "../util.h"
 
-// Forward declaration.
-static struct cmd cmd;
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
 
 static const char PROGMEM up[] = "up";
 static const char PROGMEM dn[] = "down";
@@ -28,25 +31,31 @@ map[] = {
 	{ dn, sizeof (dn), false },
 };
 
+CMD_REGISTER_MAP(seek, on_call, on_help, map);
+
+// Interval of the console updates while seeking, in microseconds.
+#define TICK_US	50000
+
 static volatile bool timer_tick;
 
 static void
 on_help (void)
 {
-	cmd_print_help(cmd.name, map, NELEM(map), STRIDE(map));
+	cmd_print_help(cmd_name, map, NELEM(map), STRIDE(map));
 }
 
-ISR (TIMER0_OVF_vect)
+static void
+on_tick (struct timer *t)
 {
-	// Scale down timer a bit more, for a 1/3072 scaling.
-	static uint8_t scale;
+	(void) t;
 
-	if (++scale == 3) {
-		scale = 0;
-		timer_tick = true;
-	}
+	timer_tick = true;
 }
 
+static struct timer ticker = {
+	.on_expire = on_tick,
+};
+
 // Sleep until a timer tick occurs.
 static void
 wait_for_tick (void)
@@ -82,11 +91,10 @@ cancel_seek (struct cmd_state *state)
 		return false;
 	}
 
-	// Wait for STCINT to become set, indicating that the chip stopped
+	// Sleep until STCINT becomes set, indicating that the chip stopped
 	// seeking and has settled on a station.
-	while (!state->tune.status.STCINT)
-		if (!si4735_tune_status(&state->tune))
-			break;
+	if (si4735_stc_wait())
+		si4735_tune_status(&state->tune);
 
 	uart_printf_P(fmt_success);
 	return true;
@@ -121,10 +129,11 @@ finish_seek (struct cmd_state *state)
 static void
 seek_status (struct cmd_state *state)
 {
-	// Setup a timer interrupt to periodically update the console.
-	TCCR0A = 0;
-	TCCR0B = _BV(CS02) | _BV(CS00);
-	TIMSK0 = _BV(TOIE0);
+	PROBE_SCOPE(SEEK_WAIT);
+
+	// Start a timer to periodically update the console.
+	timer_tick = false;
+	timer_start(&ticker, TICK_US, TICK_US);
 
 	// Clear the End-of-Text flag (Ctrl-C) by reading it.
 	uart_flag_etx();
@@ -139,8 +148,14 @@ seek_status (struct cmd_state *state)
 		if (!si4735_tune_status(&state->tune))
 			continue;
 
-		// Print current frequency.
-		uart_printf("\r%u ", state->tune.freq);
+		// Print current frequency. Don't wait for the Tx FIFO; if
+		// it is full, skip this frame. A partial frame is repaired
+		// by the carriage return of the next.
+		char frame[8];
+		const uint8_t len = format_buf(frame, sizeof (frame), false,
+			PSTR("\r%u "), state->tune.freq);
+
+		uart_try_write(frame, len);
 
 		// Quit on End-of-Text (Ctrl-C).
 		if (uart_flag_etx())
@@ -154,8 +169,7 @@ seek_status (struct cmd_state *state)
 		}
 	}
 
-	// Disable interrupt.
-	TIMSK0 &= ~_BV(TOIE0);
+	timer_stop(&ticker);
 }
 
 static bool
@@ -192,11 +206,3 @@ on_call (const struct args *args, struct cmd_state *state)
 	on_help();
 	return false;
 }
-
-static struct cmd cmd = {
-	.name    = "seek",
-	.on_call = on_call,
-	.on_help = on_help,
-};
-
-CMD_REGISTER(&cmd);
@@ -0,0 +1,61 @@
+#ifdef SI4735_STATS
+
+#include <avr/pgmspace.h>
+
+#include "../cmd.h"
+#include "../clock.h"
+#include "../spi.h"
+#include "../uart.h"
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(spi, on_call, on_help);
+
+static const char PROGMEM reset[] = "reset";
+
+static const char PROGMEM header[] =
+	"cmd calls bytes saved saved-us/call read-us/call\n";
+
+static const char PROGMEM row[] =
+	" %02x %5u %5u %5u %13lu %12lu\n";
+
+static void
+on_help (void)
+{
+	uart_printf("%p [ %p ]\n", cmd_name, reset);
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	struct si4735_stats s;
+
+	(void) state;
+
+	if (args->ac > 1) {
+		if (strncasecmp_P(args->av[1], reset, sizeof (reset)))
+			return false;
+
+		si4735_stats_reset();
+		return true;
+	}
+
+	// Print one row per command that was used, with the number of bytes
+	// that variable-length reads saved over full-length reads, and the
+	// time that saved at the SPI clock rate.
+	uart_printf_P(header);
+	for (uint8_t i = 0; si4735_stats_get(i, &s); i++) {
+		if (s.calls == 0)
+			continue;
+
+		uart_printf_P(row, s.cmd, s.calls, s.bytes, s.saved,
+			(unsigned long) s.saved * SPI_BYTE_US / s.calls,
+			(unsigned long) CLOCK_TICKS_US(s.ticks) / s.calls);
+	}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifdef PROBE_STATS
+
+#include <avr/pgmspace.h>
+
+#include "../cmd.h"
+#include "../probe.h"
+#include "../uart.h"
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(stats, on_call, on_help);
+
+static const char PROGMEM reset[] = "reset";
+
+static const char PROGMEM header[] =
+	"probe           calls    min-us    avg-us    max-us\n";
+
+static const char PROGMEM row[] =
+	"%p%p %5u %9lu %9lu %9lu\n";
+
+static const char PROGMEM bucket[] =
+	"  %c%7lu us %5u\n";
+
+// Pad probe names to a column of this width.
+#define NAME_WIDTH	15
+
+static const char PROGMEM spaces[] = "               ";
+
+static void
+on_help (void)
+{
+	uart_printf("%p [ %p ]\n", cmd_name, reset);
+}
+
+// Print the nonempty buckets of a histogram with their lower bounds. The
+// first bucket is open below and the last above.
+static void
+print_hist (const struct probe_stats *s)
+{
+	for (uint8_t b = 0; b < PROBE_BUCKETS; b++) {
+		if (s->hist[b] == 0)
+			continue;
+
+		if (b == 0)
+			uart_printf_P(bucket, '<', 16UL, s->hist[b]);
+		else
+			uart_printf_P(bucket, b == PROBE_BUCKETS - 1 ? '>' : ' ',
+				1UL << (b + 3), s->hist[b]);
+	}
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	struct probe_stats s;
+
+	(void) state;
+
+	if (args->ac > 1) {
+		if (strncasecmp_P(args->av[1], reset, sizeof (reset)))
+			return false;
+
+		probe_stats_reset();
+		return true;
+	}
+
+	// Print one row per probe that fired, followed by its histogram.
+	uart_printf_P(header);
+	for (uint8_t i = 0; probe_stats_get(i, &s); i++) {
+		if (s.calls == 0)
+			continue;
+
+		const uint8_t len = strlen_P(s.name);
+
+		uart_printf_P(row, s.name,
+			spaces + (len < NAME_WIDTH ? len : NAME_WIDTH),
+			s.calls,
+			(unsigned long) s.min,
+			(unsigned long) s.total / s.calls,
+			(unsigned long) s.max);
+
+		print_hist(&s);
+	}
+
+	return true;
+}
+
+#endif
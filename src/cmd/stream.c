@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#include "../clock.h"
+#include "../cmd.h"
+#include "../timer.h"
+#include "../uart.h"
+
+// Number of records in the ring buffer, must be a power of two.
+#define RING_SIZE	16
+
+// Length of one formatted record, including the line ending.
+#define LINE_LEN	24
+
+// Default and maximum sample rate in Hz.
+#define RATE_DEFAULT	10
+#define RATE_MAX	500
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(stream, on_call, on_help);
+
+// One compact telemetry record.
+struct record {
+	uint16_t ms;		// Timestamp in milliseconds, wraps
+	uint8_t  rssi;
+	uint8_t  snr;
+	uint8_t  mult;		// FM only
+	int8_t   freqoff;	// FM only
+	union {
+		struct {
+			uint8_t STBLEND : 7;	// FM only
+			uint8_t PILOT   : 1;	// FM only
+		};
+		uint8_t flags;
+	};
+	uint8_t  dropped;	// Records dropped before this one, saturates
+};
+
+// Ring buffer between sampling and output.
+static struct record ring[RING_SIZE];
+static uint8_t head, tail;
+
+// A sample is due when the sampler fires. Sampling talks to the chip, which
+// cannot be done from interrupt context, so the callback only flags it.
+static volatile bool     tick;
+static volatile uint32_t tick_due;	// Scheduled time of the pending tick
+static volatile uint16_t tick_missed;	// Ticks that were never sampled
+static uint32_t due;			// Scheduled time of the next tick
+
+static void
+on_tick (struct timer *t)
+{
+	uint32_t late = clock_now32() - due;
+
+	// The timer is requeued before its callback, so its expiry time is
+	// now that of the next tick.
+	tick_due = due;
+	due = t->when;
+
+	// Count periods that the timer skipped because it ran too late, and
+	// a previous tick that the main loop did not get to in time.
+	for (; late >= t->period; late -= t->period)
+		tick_missed++;
+
+	if (tick)
+		tick_missed++;
+
+	tick = true;
+}
+
+static struct timer sampler = {
+	.on_expire = on_tick,
+};
+
+static void
+on_help (void)
+{
+	uart_printf("%p [ <rate> ]\n", cmd_name);
+}
+
+static char *
+put_hex (char *p, const uint8_t c)
+{
+	static const char PROGMEM hex[] = "0123456789abcdef";
+
+	*p++ = pgm_read_byte(hex + (c >> 4));
+	*p++ = pgm_read_byte(hex + (c & 0x0F));
+	return p;
+}
+
+// Output one record as a fixed-width line of hex fields:
+//   time rssi snr multipath freqoff pilot|blend dropped
+static void
+put_record (const struct record *r)
+{
+	char line[LINE_LEN], *p = line;
+
+	p = put_hex(p, r->ms >> 8);
+	p = put_hex(p, r->ms & 0xFF);
+	*p++ = ' '; p = put_hex(p, r->rssi);
+	*p++ = ' '; p = put_hex(p, r->snr);
+	*p++ = ' '; p = put_hex(p, r->mult);
+	*p++ = ' '; p = put_hex(p, r->freqoff);
+	*p++ = ' '; p = put_hex(p, r->flags);
+	*p++ = ' '; p = put_hex(p, r->dropped);
+	*p++ = '\r';
+	*p++ = '\n';
+
+	uart_write(line, p - line);
+}
+
+// Output buffered records for as long as they fit in the Tx FIFO, so that
+// output never blocks sampling.
+static void
+drain (void)
+{
+	while (tail != head && uart_tx_free() >= LINE_LEN) {
+		put_record(&ring[tail]);
+		tail = (tail + 1) & (RING_SIZE - 1);
+	}
+}
+
+// Take the pending tick and return its scheduled time. If there is none,
+// sleep until woken by an interrupt and return false.
+static bool
+tick_take (uint32_t *when)
+{
+	cli();
+	if (tick) {
+		tick = false;
+		*when = tick_due;
+		sei();
+		return true;
+	}
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+	return false;
+}
+
+// Take a sample and queue it. Returns false if the ring is full or the chip
+// could not be read.
+static bool
+sample (const uint32_t now, const uint8_t dropped)
+{
+	struct si4735_rsq_status rsq;
+	const uint8_t next = (head + 1) & (RING_SIZE - 1);
+
+	if (next == tail)
+		return false;
+
+	if (!si4735_rsq_status(&rsq))
+		return false;
+
+	ring[head] = (struct record) {
+		.ms      = CLOCK_TICKS_US(now) / 1000,
+		.rssi    = rsq.rssi,
+		.snr     = rsq.snr,
+		.mult    = rsq.fm.mult,
+		.freqoff = rsq.fm.freqoff,
+		.STBLEND = rsq.STBLEND,
+		.PILOT   = rsq.PILOT,
+		.dropped = dropped,
+	};
+
+	head = next;
+	return true;
+}
+
+static void
+stream (const uint16_t rate)
+{
+	static const char PROGMEM fmt[] =
+		"\nSamples: %u, dropped: %u, missed: %u, max jitter: %u us\n";
+
+	uint16_t samples = 0, dropped = 0, jitter = 0;
+	uint8_t  gap = 0;
+	uint32_t when;
+
+	head = tail = 0;
+	tick = false;
+	tick_missed = 0;
+
+	// Clear the End-of-Text flag (Ctrl-C) by reading it.
+	uart_flag_etx();
+
+	// Take the first sample right away.
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		timer_start(&sampler, 0, 1000000UL / rate);
+		due = sampler.when;
+	}
+
+	// Loop until Ctrl-C is received.
+	while (!uart_flag_etx()) {
+		drain();
+
+		// Sleep until the next sample is due, or until woken up by the
+		// UART to output more records.
+		if (!tick_take(&when))
+			continue;
+
+		const uint32_t now  = clock_now32();
+		const uint32_t late = now - when;
+
+		if (late > jitter)
+			jitter = late > 0xFFFF ? 0xFFFF : late;
+
+		// Count samples dropped because the ring was full or the
+		// chip could not be read.
+		if (sample(now, gap)) {
+			samples++;
+			gap = 0;
+		} else {
+			dropped++;
+			if (gap < 0xFF)
+				gap++;
+		}
+	}
+
+	timer_stop(&sampler);
+
+	// Flush the remaining records.
+	while (tail != head) {
+		put_record(&ring[tail]);
+		tail = (tail + 1) & (RING_SIZE - 1);
+	}
+
+	uart_printf_P(fmt, samples, dropped, tick_missed, (uint16_t) CLOCK_TICKS_US(jitter));
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	int rate = RATE_DEFAULT;
+
+	if (state->band == CMD_BAND_NONE)
+		return false;
+
+	if (args->ac > 1)
+		if ((rate = atoi(args->av[1])) <= 0 || rate > RATE_MAX) {
+			on_help();
+			return false;
+		}
+
+	stream(rate);
+	return true;
+}
@@ -0,0 +1,70 @@
+#include <avr/pgmspace.h>
+
+#include "../cmd.h"
+#include "../readline.h"
+#include "../uart.h"
+#include "../util.h"
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+static const char PROGMEM ansi[]  = "ansi";
+static const char PROGMEM dumb[]  = "dumb";
+#ifdef READLINE_STATS
+static const char PROGMEM stats[] = "stats";
+#endif
+
+static void set_ansi   (void) { readline_ansi(true);  }
+static void set_dumb   (void) { readline_ansi(false); }
+
+#ifdef READLINE_STATS
+static void
+show_stats (void)
+{
+	readline_stats_print();
+	readline_stats_reset();
+}
+#endif
+
+// Subcommand map.
+static const struct {
+	const char *cmd;
+	void (* on_call) (void);
+}
+map[] = {
+	{ ansi,  set_ansi   },
+	{ dumb,  set_dumb   },
+#ifdef READLINE_STATS
+	{ stats, show_stats },
+#endif
+};
+
+CMD_REGISTER_MAP(term, on_call, on_help, map);
+
+static void
+on_help (void)
+{
+	cmd_print_help(cmd_name, map, NELEM(map), STRIDE(map));
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	(void) state;
+
+	// Without arguments, show the terminal type.
+	if (args->ac < 2) {
+		uart_printf("%p\n", readline_is_ansi() ? ansi : dumb);
+		return true;
+	}
+
+	FOREACH (map, m)
+		if (!strcasecmp_P(args->av[1], m->cmd)) {
+			m->on_call();
+			return true;
+		}
+
+	on_help();
+	return false;
+}
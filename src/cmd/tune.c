@@ -5,8 +5,11 @@
 #include "../cmd.h"
 #include "../uart.h"
 
-// Forward declaration.
-static struct cmd cmd;
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(tune, on_call, on_help);
 
 static const char PROGMEM up[] = "up";
 static const char PROGMEM dn[] = "down";
@@ -14,22 +17,7 @@ static const char PROGMEM dn[] = "down";
 static void
 on_help (void)
 {
-	uart_printf("%s [ %p | %p | <freq> ]\n", cmd.name, up, dn);
-}
-
-static bool
-freq_set (struct cmd_state *state, const uint16_t freq)
-{
-	if (!si4735_freq_set(freq, false, false, state->band == CMD_BAND_SW))
-		return false;
-
-	// If the command was successful, wait for STCINT to become set,
-	// to indicate that the chip has settled on a frequency.
-	while (si4735_tune_status(&state->tune))
-		if (state->tune.status.STCINT)
-			return true;
-
-	return false;
+	uart_printf("%p [ %p | %p | <freq> ]\n", cmd_name, up, dn);
 }
 
 static bool
@@ -43,7 +31,7 @@ freq_nudge (struct cmd_state *state, bool up)
 	freq = up ? state->tune.freq + 1
 	          : state->tune.freq - 1;
 
-	return freq_set(state, freq);
+	return cmd_tune(state, freq);
 }
 
 static bool
@@ -68,13 +56,5 @@ on_call (const struct args *args, struct cmd_state *state)
 	if ((freq = atoi(args->av[1])) <= 0)
 		return false;
 
-	return freq_set(state, freq);
+	return cmd_tune(state, freq);
 }
-
-static struct cmd cmd = {
-	.name    = "tune",
-	.on_call = on_call,
-	.on_help = on_help,
-};
-
-CMD_REGISTER(&cmd);
@@ -0,0 +1,44 @@
+#include <avr/pgmspace.h>
+
+#include "../cmd.h"
+#include "../uart.h"
+
+// Forward declarations.
+static bool on_call (const struct args *args, struct cmd_state *state);
+static void on_help (void);
+
+CMD_REGISTER(uart, on_call, on_help);
+
+static const char PROGMEM reset[] = "reset";
+
+static const char PROGMEM fmt[] =
+	"overrun    : %u\n"
+	"frame      : %u\n"
+	"dropped    : %u\n"
+	"throttled  : %u\n";
+
+static void
+on_help (void)
+{
+	uart_printf("%p [ %p ]\n", cmd_name, reset);
+}
+
+static bool
+on_call (const struct args *args, struct cmd_state *state)
+{
+	struct uart_stats s;
+
+	(void) state;
+
+	if (args->ac > 1) {
+		if (strncasecmp_P(args->av[1], reset, sizeof (reset)))
+			return false;
+
+		uart_stats_reset();
+		return true;
+	}
+
+	uart_stats_get(&s);
+	uart_printf_P(fmt, s.overrun, s.frame, s.dropped, s.throttled);
+	return true;
+}
@@ -0,0 +1,270 @@
+#include <avr/pgmspace.h>
+
+#include "format.h"
+#include "probe.h"
+#include "util.h"
+
+// Size of the output buffer. Text is passed to the output function in
+// chunks of at most this size.
+#define CHUNK	16
+
+// Powers of ten for decimal conversion by repeated subtraction, because the
+// AVR has no hardware divider. The 32-bit table takes numbers down to below
+// ten thousand, after which 16-bit arithmetic suffices.
+static const uint32_t PROGMEM pow10_32[] = {
+	1000000000, 100000000, 10000000, 1000000, 100000, 10000,
+};
+
+static const uint16_t PROGMEM pow10_16[] = {
+	10000, 1000, 100, 10,
+};
+
+static struct {
+	format_emit emit;
+	uint8_t     len;
+	char        buf[CHUNK];
+} out;
+
+static void
+flush (void)
+{
+	if (out.len)
+		out.emit(out.buf, out.len);
+
+	out.len = 0;
+}
+
+static inline void
+put (const char c)
+{
+	out.buf[out.len++] = c;
+
+	if (out.len == sizeof (out.buf))
+		flush();
+}
+
+// Convert to decimal, writing the digits to buf. Returns the digit count.
+static uint8_t
+conv_dec (uint32_t v, char *buf)
+{
+	uint8_t n = 0, i = 0;
+
+	// Numbers below 65536 skip the 32-bit stage entirely. Otherwise, it
+	// takes them below 10000, and the 16-bit stage skips that power.
+	if (v > 0xFFFF) {
+		FOREACH (pow10_32, p) {
+			const uint32_t pow = pgm_read_dword(p);
+			char d = '0';
+
+			while (v >= pow) {
+				v -= pow;
+				d++;
+			}
+
+			if (n || d != '0')
+				buf[n++] = d;
+		}
+		i = 1;
+	}
+
+	uint16_t w = v;
+
+	for (; i < NELEM(pow10_16); i++) {
+		const uint16_t pow = pgm_read_word(&pow10_16[i]);
+		char d = '0';
+
+		while (w >= pow) {
+			w -= pow;
+			d++;
+		}
+
+		if (n || d != '0')
+			buf[n++] = d;
+	}
+
+	buf[n++] = '0' + w;
+	return n;
+}
+
+// Convert to hexadecimal by shifting out nibbles. Returns the digit count.
+static uint8_t
+conv_hex (const uint32_t v, char *buf)
+{
+	static const char PROGMEM hex[] = "0123456789ABCDEF";
+	uint8_t n = 0;
+
+	for (int8_t shift = 28; shift >= 0; shift -= 4) {
+		const uint8_t d = (v >> shift) & 0x0F;
+
+		if (n || d || shift == 0)
+			buf[n++] = pgm_read_byte(hex + d);
+	}
+
+	return n;
+}
+
+// Output a converted number, padded to the field width.
+static void
+put_num (const char *digits, const uint8_t len, const bool neg, uint8_t width, const bool zero)
+{
+	width = (width > len + neg) ? width - len - neg : 0;
+
+	if (!zero)
+		while (width--)
+			put(' ');
+
+	if (neg)
+		put('-');
+
+	if (zero)
+		while (width--)
+			put('0');
+
+	for (uint8_t i = 0; i < len; i++)
+		put(digits[i]);
+}
+
+void
+format (format_emit emit, const bool ram, const char *restrict fmt, va_list ap)
+{
+	PROBE_SCOPE(FORMAT);
+	char c;
+
+	out.emit = emit;
+	out.len  = 0;
+
+	while ((c = ram ? *fmt++ : pgm_read_byte(fmt++)) != 0) {
+		switch (c) {
+		case '%': {
+			char     digits[10];
+			uint32_t v;
+			uint8_t  width = 0;
+			bool     neg = false, zero = false, wide = false;
+
+			c = ram ? *fmt++ : pgm_read_byte(fmt++);
+
+			// Zero padding flag.
+			if (c == '0') {
+				zero = true;
+				c = ram ? *fmt++ : pgm_read_byte(fmt++);
+			}
+
+			// Field width.
+			for (; c >= '0' && c <= '9'; c = ram ? *fmt++ : pgm_read_byte(fmt++))
+				width = width * 10 + (c - '0');
+
+			// Length modifier.
+			if (c == 'l') {
+				wide = true;
+				c = ram ? *fmt++ : pgm_read_byte(fmt++);
+			}
+
+			switch (c) {
+			case 0:
+				fmt--;
+				break;
+
+			case '%':
+				put('%');
+				break;
+
+			case 'c': {
+				PROBE_SCOPE(FORMAT_C);
+				put(va_arg(ap, int));
+				break;
+			}
+
+			case 's': {
+				PROBE_SCOPE(FORMAT_S);
+				const char *s = va_arg(ap, char *);
+				while ((c = *s++))
+					put(c);
+				break;
+			}
+
+			case 'p': {
+				PROBE_SCOPE(FORMAT_P);
+				const char *s = va_arg(ap, char *);
+				while ((c = pgm_read_byte(s++)))
+					put(c);
+				break;
+			}
+
+			case 'd': {
+				PROBE_SCOPE(FORMAT_D);
+				const int32_t d = wide ? va_arg(ap, long) : va_arg(ap, int);
+				if ((neg = d < 0))
+					v = -(uint32_t) d;
+				else
+					v = d;
+				put_num(digits, conv_dec(v, digits), neg, width, zero);
+				break;
+			}
+
+			case 'u': {
+				PROBE_SCOPE(FORMAT_U);
+				v = wide ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int);
+				put_num(digits, conv_dec(v, digits), false, width, zero);
+				break;
+			}
+
+			case 'x': {
+				PROBE_SCOPE(FORMAT_X);
+				v = wide ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int);
+				put_num(digits, conv_hex(v, digits), false, width, zero);
+				break;
+			}
+			}
+			break;
+		}
+
+		case '\n':
+			put('\r');
+			// Fallthrough
+
+		default:
+			put(c);
+			break;
+		}
+	}
+
+	flush();
+}
+
+// State for formatting into a buffer.
+static struct {
+	char    *buf;
+	uint8_t  free;
+} dest;
+
+static void
+emit_buf (const char *buf, uint8_t len)
+{
+	if (len > dest.free)
+		len = dest.free;
+
+	for (uint8_t i = 0; i < len; i++)
+		*dest.buf++ = buf[i];
+
+	dest.free -= len;
+}
+
+uint8_t
+format_buf (char *buf, const uint8_t size, const bool ram, const char *restrict fmt, ...)
+{
+	va_list ap;
+
+	if (size == 0)
+		return 0;
+
+	// Reserve space for the terminating zero.
+	dest.buf  = buf;
+	dest.free = size - 1;
+
+	va_start(ap, fmt);
+	format(emit_buf, ram, fmt, ap);
+	va_end(ap);
+
+	*dest.buf = '\0';
+	return dest.buf - buf;
+}
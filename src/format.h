@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Output function that receives formatted text in chunks.
+typedef void (* format_emit) (const char *buf, uint8_t len);
+
+// Format a RAM-based or PROGMEM-based format string. Supports the %c, %s,
+// %p (PROGMEM string), %d, %u and %x conversions, with an optional field
+// width, zero padding, and the 'l' modifier for 32-bit values. Newlines are
+// expanded to CR/LF.
+extern void format (format_emit emit, const bool ram, const char *restrict fmt, va_list ap);
+
+// Format into a buffer of the given size, always zero-terminating it.
+// Returns the length of the formatted string, which is truncated if the
+// buffer is too small.
+extern uint8_t format_buf (char *buf, const uint8_t size, const bool ram, const char *restrict fmt, ...);
@@ -1,7 +1,9 @@
 #include <avr/interrupt.h>
 
 #include "args.h"
+#include "clock.h"
 #include "cmd.h"
+#include "rds.h"
 #include "readline.h"
 #include "si4735.h"
 #include "uart.h"
@@ -14,9 +16,16 @@ main (void)
 
 	// Initialize.
 	uart_init();
+	clock_init();
 	si4735_init();
 	cmd_init();
 
+	// Decode RDS data in the background while waiting for input.
+	uart_idle(rds_poll);
+
+	// Complete command names on Tab.
+	readline_complete(cmd_complete);
+
 	// Main loop.
 	for (;;) {
 		struct args args;
@@ -0,0 +1,74 @@
+#include <avr/eeprom.h>
+
+#include "preset.h"
+
+// Every slot is spread over a ring of copies in EEPROM, and each store goes
+// to the next copy in the ring. This spreads the wear over all copies. The
+// latest copy is found through its sequence number, which is one higher
+// than that of its predecessor.
+#define PRESET_COPIES	4
+
+// Band value of an erased EEPROM cell, marking an empty slot.
+#define BAND_EMPTY	0xFF
+
+struct record {
+	uint8_t       seq;
+	struct preset preset;
+};
+
+static struct record EEMEM eeprom[PRESET_SLOTS][PRESET_COPIES];
+
+// Find the index of the latest copy in a slot's ring.
+static uint8_t
+latest (const struct record *ring)
+{
+	uint8_t i, seq = eeprom_read_byte(&ring[0].seq);
+
+	for (i = 1; i < PRESET_COPIES; i++) {
+		const uint8_t next = eeprom_read_byte(&ring[i].seq);
+
+		if (next != (uint8_t) (seq + 1))
+			break;
+
+		seq = next;
+	}
+
+	return i - 1;
+}
+
+bool
+preset_load (const uint8_t slot, struct preset *preset)
+{
+	if (slot >= PRESET_SLOTS)
+		return false;
+
+	const struct record *ring = eeprom[slot];
+
+	eeprom_read_block(preset, &ring[latest(ring)].preset, sizeof (*preset));
+	return preset->band != BAND_EMPTY;
+}
+
+bool
+preset_store (const uint8_t slot, const struct preset *preset)
+{
+	struct record rec;
+
+	if (slot >= PRESET_SLOTS)
+		return false;
+
+	struct record *ring = eeprom[slot];
+	const uint8_t  cur  = latest(ring);
+	struct record *next = &ring[(cur + 1) % PRESET_COPIES];
+
+	// Nothing to do if the slot already holds this preset.
+	eeprom_read_block(&rec, &ring[cur], sizeof (rec));
+	if (rec.preset.band == preset->band && rec.preset.freq == preset->freq)
+		return true;
+
+	// Write the next copy in the ring, the sequence number last. Until
+	// that single byte is written, the copy is not the latest, so losing
+	// power halfway through leaves the previous copy in place.
+	eeprom_update_block(preset, &next->preset, sizeof (*preset));
+	eeprom_update_byte(&next->seq, rec.seq + 1);
+	return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Number of preset slots.
+#define PRESET_SLOTS	8
+
+struct preset {
+	uint8_t  band;
+	uint16_t freq;
+};
+
+extern bool preset_load (const uint8_t slot, struct preset *preset);
+extern bool preset_store (const uint8_t slot, const struct preset *preset);
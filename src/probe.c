@@ -0,0 +1,87 @@
+#ifdef PROBE_STATS
+
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "clock.h"
+#include "probe.h"
+
+#define PROBE_NAME(ID, NAME)	static const char PROGMEM name_##ID[] = NAME;
+#define PROBE_ENTRY(ID, NAME)	name_##ID,
+
+PROBES_TIMED(PROBE_NAME)
+
+static const char *const PROGMEM names[PROBE_TIMED_COUNT] = {
+	PROBES_TIMED(PROBE_ENTRY)
+};
+
+// Statistics per timed probe, indexed by probe id minus one. The names are
+// filled in when read out.
+static struct probe_stats stats[PROBE_TIMED_COUNT];
+
+// Get the histogram bucket for a time in microseconds: the bit length of
+// the time in units of 16 us, capped at the last bucket.
+static uint8_t
+bucket (uint32_t us)
+{
+	uint8_t b = 0;
+
+	for (us >>= 4; us && b < PROBE_BUCKETS - 1; us >>= 1)
+		b++;
+
+	return b;
+}
+
+// Add a time to a probe's statistics. Can be called from interrupt context.
+void
+probe_record (const uint8_t id, const uint32_t ticks)
+{
+	const uint32_t us = CLOCK_TICKS_US(ticks);
+	const uint8_t b = bucket(us);
+
+	if (id == PROBE_NONE || id > PROBE_TIMED_COUNT)
+		return;
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		struct probe_stats *s = &stats[id - 1];
+
+		// Stop counting when the call count would wrap, so that the
+		// average stays right.
+		if (s->calls < UINT16_MAX) {
+			if (s->calls == 0 || us < s->min)
+				s->min = us;
+
+			if (us > s->max)
+				s->max = us;
+
+			s->total += us;
+			s->calls++;
+			s->hist[b]++;
+		}
+	}
+}
+
+// Copy the statistics of the probe with the given index. Returns false
+// past the last probe.
+bool
+probe_stats_get (const uint8_t i, struct probe_stats *buf)
+{
+	if (i >= PROBE_TIMED_COUNT)
+		return false;
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+		*buf = stats[i];
+
+	buf->name = pgm_read_ptr(&names[i]);
+	return true;
+}
+
+void
+probe_stats_reset (void)
+{
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+		memset(stats, 0, sizeof (stats));
+}
+
+#endif
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Probe points around code paths worth timing. A probe marks the entry to
+// its scope and, through the cleanup attribute, every way out of it. Without
+// a probe backend, probes compile to nothing. The backends are:
+//
+//   PROBE_GPIOR: the marks are writes of the probe id to GPIOR0, one
+//   instruction each, which a simulator can watch to count the cycles in
+//   between; see tools/bench.c.
+//
+//   PROBE_STATS: the probes in PROBES_TIMED time their scope with the
+//   Timer1 clock and keep a histogram per probe, which the 'stats' command
+//   shows. The other probes compile to nothing.
+
+// Probes that are cheap and few enough to time on the target.
+#define PROBES_TIMED(X)					\
+	X(SPI,			"spi xfer")		\
+	X(DISPATCH,		"dispatch_cmd")		\
+	X(SI4735_STC_WAIT,	"si4735_stc_wait")	\
+	X(SEEK_WAIT,		"seek wait")
+
+// Probes that only the simulator watches.
+#define PROBES_TRACE(X)					\
+	X(FORMAT,		"format")		\
+	X(FORMAT_C,		"format %c")		\
+	X(FORMAT_S,		"format %s")		\
+	X(FORMAT_P,		"format %p")		\
+	X(FORMAT_D,		"format %d")		\
+	X(FORMAT_U,		"format %u")		\
+	X(FORMAT_X,		"format %x")		\
+	X(ARGS_PARSE,		"args_parse")		\
+	X(READLINE_KEY,		"readline key")		\
+	X(SI4735_REV_GET,	"si4735_rev_get")	\
+	X(SI4735_PROP_GET,	"si4735_prop_get")	\
+	X(SI4735_PROP_SET,	"si4735_prop_set")	\
+	X(SI4735_POWER_UP,	"si4735_power_up")	\
+	X(SI4735_POWER_DOWN,	"si4735_power_down")	\
+	X(SI4735_FREQ_SET,	"si4735_freq_set")	\
+	X(SI4735_SEEK_START,	"si4735_seek_start")	\
+	X(SI4735_SEEK_CANCEL,	"si4735_seek_cancel")	\
+	X(SI4735_TUNE_STATUS,	"si4735_tune_status")	\
+	X(SI4735_RSQ_STATUS,	"si4735_rsq_status")	\
+	X(SI4735_RDS_STATUS,	"si4735_rds_status")
+
+#define PROBES(X)	PROBES_TIMED(X) PROBES_TRACE(X)
+
+#define PROBE_ENUM(ID, NAME)	PROBE_##ID,
+
+// Probe ids. The timed probes come first, numbered from one.
+enum probe_id {
+	PROBE_NONE,
+	PROBES_TIMED(PROBE_ENUM)
+	PROBE_TRACE_FIRST,
+	PROBE_TIMED_COUNT = PROBE_TRACE_FIRST - 1,
+	PROBE_TRACE_BASE  = PROBE_TIMED_COUNT,
+	PROBES_TRACE(PROBE_ENUM)
+	PROBE_COUNT
+};
+
+// Set in the id written on the way out.
+#define PROBE_EXIT	0x80
+
+// Number of histogram buckets. Bucket 0 counts times under 16 us, bucket n
+// times from 2^(n+3) us up to twice that, and the last bucket everything
+// longer, from about a second.
+#define PROBE_BUCKETS	18
+
+struct probe_stats {
+	const char *name;		// PROGMEM string
+	uint16_t    calls;
+	uint32_t    min;		// Microseconds
+	uint32_t    max;
+	uint32_t    total;
+	uint16_t    hist[PROBE_BUCKETS];
+};
+
+#if defined(PROBE_GPIOR)
+#include <avr/io.h>
+
+static inline uint8_t
+probe_enter (const uint8_t id)
+{
+	__asm__ volatile ("" ::: "memory");
+	GPIOR0 = id;
+	return id;
+}
+
+static inline void
+probe_exit (const uint8_t *id)
+{
+	GPIOR0 = *id | PROBE_EXIT;
+	__asm__ volatile ("" ::: "memory");
+}
+
+#define PROBE_SCOPE(ID)							\
+	const uint8_t probe_scope					\
+	__attribute__((cleanup(probe_exit), unused)) = probe_enter(PROBE_##ID)
+
+#define PROBE_RECORD(ID, TICKS)						\
+	do { } while (0)
+
+#elif defined(PROBE_STATS)
+#include "clock.h"
+
+extern void probe_record (const uint8_t id, const uint32_t ticks);
+extern bool probe_stats_get (const uint8_t i, struct probe_stats *buf);
+extern void probe_stats_reset (void);
+
+struct probe_scope {
+	uint8_t  id;
+	uint32_t start;
+};
+
+// Both halves are inlined, so that the test against the probe id folds
+// away and the trace probes leave no code.
+static inline __attribute__((always_inline)) struct probe_scope
+probe_start (const uint8_t id)
+{
+	return (struct probe_scope) {
+		.id    = id,
+		.start = id <= PROBE_TIMED_COUNT ? clock_now32() : 0,
+	};
+}
+
+static inline __attribute__((always_inline)) void
+probe_stop (const struct probe_scope *s)
+{
+	if (s->id <= PROBE_TIMED_COUNT)
+		probe_record(s->id, clock_now32() - s->start);
+}
+
+#define PROBE_SCOPE(ID)							\
+	const struct probe_scope probe_scope				\
+	__attribute__((cleanup(probe_stop), unused)) = probe_start(PROBE_##ID)
+
+// Record a time measured by other means, in clock ticks.
+#define PROBE_RECORD(ID, TICKS)						\
+	probe_record(PROBE_##ID, TICKS)
+
+#else
+#define PROBE_SCOPE(ID)							\
+	do { } while (0)
+
+#define PROBE_RECORD(ID, TICKS)						\
+	do { } while (0)
+#endif
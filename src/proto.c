@@ -0,0 +1,204 @@
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+#include "args.h"
+#include "proto.h"
+#include "uart.h"
+#include "version.h"
+
+// A pipelined request must fit in the receive FIFO while the firmware is
+// busy with the previous one, unless the sender can be paused.
+#if defined(UART_RX_SIZE) && !defined(UART_FLOW_XON) && !defined(UART_FLOW_RTS)
+#if UART_RX_SIZE - 1 < 2 * (PROTO_MAX + PROTO_FRAMING)
+#error "UART_RX_SIZE cannot hold two protocol frames; raise it or enable UART_FLOW"
+#endif
+#endif
+
+// The last received request. One spare byte zero-terminates command lines.
+static struct {
+	uint8_t len;
+	uint8_t op;
+	uint8_t seq;
+	uint8_t data[PROTO_MAX + 1];
+} req;
+
+// Running checksum of the frame being received or sent.
+static uint8_t crc;
+
+static uint8_t
+getc_crc (void)
+{
+	const uint8_t c = uart_getchar();
+
+	crc = _crc8_ccitt_update(crc, c);
+	return c;
+}
+
+static void
+putc_crc (const uint8_t c)
+{
+	crc = _crc8_ccitt_update(crc, c);
+	uart_putc(c);
+}
+
+// Receive the next request frame.
+static enum proto_status
+recv (void)
+{
+	// Skip to the start of a frame.
+	while (uart_getchar() != PROTO_SYNC)
+		continue;
+
+	crc     = 0;
+	req.len = getc_crc();
+	req.op  = getc_crc();
+	req.seq = getc_crc();
+
+	// Resynchronize on the next frame.
+	if (req.len > PROTO_MAX)
+		return PROTO_ERR_LENGTH;
+
+	for (uint8_t i = 0; i < req.len; i++)
+		req.data[i] = getc_crc();
+
+	// Including the checksum byte, the checksum of a valid frame is zero.
+	getc_crc();
+	return crc ? PROTO_ERR_CRC : PROTO_OK;
+}
+
+// Send a response frame for the last request.
+static void
+send (const enum proto_status status, const void *data, uint8_t len)
+{
+	const uint8_t *p = data;
+
+	uart_putc(PROTO_SYNC);
+
+	crc = 0;
+	putc_crc(len + 1);
+	putc_crc(req.op | 0x80);
+	putc_crc(req.seq);
+	putc_crc(status);
+
+	while (len--)
+		putc_crc(*p++);
+
+	uart_putc(crc);
+}
+
+static void
+send_tune_status (const bool ok, const struct cmd_state *state)
+{
+	send(ok ? PROTO_OK : PROTO_FAILED, &state->tune, sizeof (state->tune));
+}
+
+// Commands that run until cancelled with Ctrl-C, which is data in raw mode,
+// or that take over the console.
+static const char PROGMEM refused[][7] = {
+	"baud",
+	"binary",
+	"seek",
+	"stream",
+};
+
+static bool
+interactive (const char *name)
+{
+	FOREACH (refused, r)
+		if (!strcasecmp_P(name, *r))
+			return true;
+
+	return false;
+}
+
+// Run a command line through the regular command handlers, with their text
+// output muted.
+static void
+exec (struct cmd_state *state)
+{
+	struct args args;
+	bool ok;
+
+	req.data[req.len] = '\0';
+	args_parse((char *) req.data, &args);
+
+	if (args.ac && interactive(args.av[0])) {
+		send(PROTO_ERR_REFUSED, NULL, 0);
+		return;
+	}
+
+	uart_mute(true);
+	ok = cmd_dispatch(&args);
+	uart_mute(false);
+
+	send_tune_status(ok, state);
+}
+
+static void
+rsq_status (void)
+{
+	struct si4735_rsq_status rsq;
+	const bool ok = si4735_rsq_status_cached(&rsq);
+
+	send(ok ? PROTO_OK : PROTO_FAILED, &rsq, sizeof (rsq));
+}
+
+static void
+tune (struct cmd_state *state)
+{
+	if (req.len != sizeof (uint16_t)) {
+		send(PROTO_ERR_LENGTH, NULL, 0);
+		return;
+	}
+
+	send_tune_status(cmd_tune(state, req.data[0] | req.data[1] << 8), state);
+}
+
+// Serve binary requests until the host sends an exit request.
+void
+proto_run (struct cmd_state *state)
+{
+	uart_raw(true);
+
+	for (;;) {
+		const enum proto_status status = recv();
+
+		if (status != PROTO_OK) {
+			send(status, NULL, 0);
+			continue;
+		}
+
+		switch (req.op) {
+		case PROTO_OP_PING:
+			send(PROTO_OK, version, strlen(version));
+			break;
+
+		case PROTO_OP_EXEC:
+			exec(state);
+			break;
+
+		case PROTO_OP_TUNE_STATUS:
+			send_tune_status(si4735_tune_status_cached(&state->tune), state);
+			break;
+
+		case PROTO_OP_RSQ_STATUS:
+			rsq_status();
+			break;
+
+		case PROTO_OP_TUNE:
+			tune(state);
+			break;
+
+		case PROTO_OP_EXIT:
+			send(PROTO_OK, NULL, 0);
+			uart_raw(false);
+			return;
+
+		default:
+			send(PROTO_ERR_OP, NULL, 0);
+			break;
+		}
+	}
+}
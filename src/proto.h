@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "cmd.h"
+
+// Binary host protocol. Requests and responses share one frame layout:
+//
+//   SYNC LEN OP SEQ DATA[LEN] CRC
+//
+// CRC is a CRC-8-CCITT over LEN, OP, SEQ and DATA. A response echoes the
+// opcode with its top bit set and the sequence number of the request. Its
+// first data byte is a status code, followed by the response data as raw,
+// packed structures in little-endian byte order. Hosts may send the next
+// request before the response to the last one has arrived. Without flow
+// control, the receive FIFO holds two frames of the maximum length, so up to
+// two requests can wait behind the one being served.
+//
+// The first request must wait for the echo of the 'binary' command, because
+// the console takes 0x03 as Ctrl-C until then.
+#define PROTO_SYNC	0xA5
+#define PROTO_MAX	24
+
+// Length of a frame around its data.
+#define PROTO_FRAMING	5
+
+// Opcodes.
+enum proto_op {
+	PROTO_OP_PING        = 0x00,	// Returns the version string
+	PROTO_OP_EXEC        = 0x01,	// Runs a command line, returns tune status
+	PROTO_OP_TUNE_STATUS = 0x02,	// Returns struct si4735_tune_status
+	PROTO_OP_RSQ_STATUS  = 0x03,	// Returns struct si4735_rsq_status
+	PROTO_OP_TUNE        = 0x04,	// Tunes to uint16_t freq, returns tune status
+	PROTO_OP_EXIT        = 0x7F,	// Returns to the text console
+};
+
+// Response status codes.
+enum proto_status {
+	PROTO_OK,
+	PROTO_FAILED,
+	PROTO_ERR_CRC,
+	PROTO_ERR_LENGTH,
+	PROTO_ERR_OP,
+	PROTO_ERR_REFUSED,	// Command cannot run over the protocol
+};
+
+extern void proto_run (struct cmd_state *state);
@@ -0,0 +1,143 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "rds.h"
+#include "si4735.h"
+
+// Group types we decode.
+#define GROUP_PS	0	// Basic tuning and switching information
+#define GROUP_RT	2	// RadioText
+
+// Block error level for which blocks are unusable.
+#define BLE_UNCORRECTABLE	3
+
+static struct rds rds;
+
+// Tune count of the station the data belongs to.
+static uint8_t tune_count;
+
+static void
+reset (void)
+{
+	memset(&rds, 0, sizeof (rds));
+	memset(rds.ps, ' ', sizeof (rds.ps) - 1);
+	memset(rds.rt, ' ', sizeof (rds.rt) - 1);
+}
+
+// Forget the data of a previous station.
+static void
+check_station (void)
+{
+	if (tune_count != si4735_tune_count()) {
+		tune_count = si4735_tune_count();
+		reset();
+	}
+}
+
+// Store a received character, replacing unprintable ones.
+static void
+put_char (char *dst, const uint8_t c)
+{
+	*dst = (c < 0x20 || c > 0x7E) ? ' ' : c;
+}
+
+// Store two characters of RadioText at the given offset. A carriage return
+// marks the end of the text.
+static void
+put_rt (const uint8_t pos, const uint16_t chars)
+{
+	const uint8_t c[2] = { chars >> 8, chars & 0xFF };
+
+	for (uint8_t i = 0; i < 2; i++) {
+		if (c[i] == '\r') {
+			rds.rt[pos + i] = '\0';
+			return;
+		}
+		put_char(&rds.rt[pos + i], c[i]);
+	}
+}
+
+static void
+decode (const struct si4735_rds_status *s)
+{
+	// Without a usable block B, the group type is unknown.
+	if (s->BLEB == BLE_UNCORRECTABLE)
+		return;
+
+	const uint16_t b     = s->block[1];
+	const uint8_t  type  = b >> 12;
+	const bool     vb    = b & 0x0800;
+	const uint8_t  seg   = b & 0x000F;
+
+	// A new program identifier means a new station.
+	if (s->BLEA != BLE_UNCORRECTABLE && s->block[0] != rds.pi) {
+		reset();
+		rds.pi = s->block[0];
+	}
+
+	rds.pty = (b >> 5) & 0x1F;
+	rds.groups++;
+
+	switch (type) {
+	case GROUP_PS:
+		// Two characters of the name in block D.
+		if (s->BLED == BLE_UNCORRECTABLE)
+			break;
+
+		put_char(&rds.ps[(seg & 3) * 2 + 0], s->block[3] >> 8);
+		put_char(&rds.ps[(seg & 3) * 2 + 1], s->block[3] & 0xFF);
+		break;
+
+	case GROUP_RT:
+		// Clear the text when the A/B flag toggles.
+		if (((b >> 4) & 1) != rds.ab) {
+			rds.ab = (b >> 4) & 1;
+			memset(rds.rt, ' ', sizeof (rds.rt) - 1);
+		}
+
+		// Version A carries four characters in blocks C and D,
+		// version B carries two in block D.
+		if (vb) {
+			if (s->BLED != BLE_UNCORRECTABLE)
+				put_rt(seg * 2, s->block[3]);
+			break;
+		}
+
+		if (s->BLEC != BLE_UNCORRECTABLE)
+			put_rt(seg * 4 + 0, s->block[2]);
+
+		if (s->BLED != BLE_UNCORRECTABLE)
+			put_rt(seg * 4 + 2, s->block[3]);
+
+		break;
+	}
+}
+
+// Drain the chip's RDS FIFO if it signalled an interrupt. Cheap enough to
+// call whenever the CPU is idle.
+void
+rds_poll (void)
+{
+	struct si4735_rds_status s;
+
+	if (!si4735_rds_pending())
+		return;
+
+	check_station();
+
+	// Acknowledge the interrupt with the first read. Each read returns
+	// one group; stop when the FIFO is empty.
+	for (bool ack = true; si4735_rds_status(&s, ack); ack = false) {
+		if (s.fifo_used == 0)
+			break;
+
+		decode(&s);
+	}
+}
+
+const struct rds *
+rds_get (void)
+{
+	check_station();
+	return &rds;
+}
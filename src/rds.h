@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decoded RDS data of the current station.
+struct rds {
+	uint16_t pi;		// Program Identification
+	uint8_t  pty;		// Program Type
+	uint8_t  ab;		// RadioText A/B flag
+	uint16_t groups;	// Groups decoded
+	char     ps[9];		// Program Service name
+	char     rt[65];	// RadioText
+};
+
+extern const struct rds *rds_get (void);
+extern void rds_poll (void);
@@ -1,6 +1,10 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
 
+#include "clock.h"
+#include "probe.h"
 #include "readline.h"
 #include "uart.h"
 #include "util.h"
@@ -8,19 +12,57 @@
 // Size of the line buffer:
 #define LINESIZE	40
 
-// Double-buffered line buffer.
-static char line[2U][LINESIZE];
+// Size of the history ring. Must be a power of two, and small enough for
+// the 8-bit byte count.
+#ifndef HISTSIZE
+#define HISTSIZE	64
+#endif
 
-// Line metadata: total length, cursor position, double buffer index.
-static uint8_t llen, lpos, lbuf;
+#if HISTSIZE & (HISTSIZE - 1) || HISTSIZE > 128 || HISTSIZE <= LINESIZE
+#error "HISTSIZE must be a power of two, above LINESIZE and at most 128"
+#endif
 
-// Writable output buffer that is returned to the caller.
-static char outbuf[LINESIZE];
+#define HISTMASK	(HISTSIZE - 1)
+
+// Line being edited, with room for the terminating zero. It is returned
+// to the caller as-is, who may modify it: it is saved to history first.
+static char line[LINESIZE + 1];
+
+// The line that was being typed when Up was first pressed, zero-terminated.
+// Down brings it back.
+static char scratch[LINESIZE + 1];
+
+// Line metadata: total length, cursor position.
+static uint8_t llen, lpos;
+
+// History ring of zero-terminated lines, packed back to back. The newest
+// line ends just before the head. Old lines are evicted to make room.
+static char hist[HISTSIZE];
+
+// Ring head, bytes used, number of lines, and the line currently shown,
+// counting from 1 for the newest, or 0 for a new line.
+static uint8_t hhead, hused, hcount, hsel;
+
+// Tab completion function.
+static readline_completer completer;
+
+// Whether the terminal understands ANSI cursor control. If not, the cursor
+// is moved with backspaces and reprinted characters only.
+static bool ansi = true;
+
+// What the terminal shows: the line length and the cursor column.
+static uint8_t slen, scol;
+
+// Milliseconds to wait for the rest of an escape sequence. A lone ESC
+// is dropped after this time, so that it does not swallow the next key.
+#define ESC_TIMEOUT_MS	30
 
 // Keys we distinguish:
 enum keytype {
+	KEY_NONE,
 	KEY_REGULAR,
 	KEY_BKSP,
+	KEY_TAB,
 	KEY_ENTER,
 	KEY_HOME,
 	KEY_DEL,
@@ -31,274 +73,620 @@ enum keytype {
 	KEY_ARROWDN,
 	KEY_ARROWRT,
 	KEY_ARROWLT,
+	KEY_KILL_END,
+	KEY_KILL_START,
+	KEY_KILL_WORD,
 };
 
-// Scancodes for special keys, sorted lexicographically:
-static const uint8_t key_bksp[]		= { 0x08			};
-static const uint8_t key_enter[]	= { 0x0D			};
-static const uint8_t key_home[]		= { 0x1B, 0x5B, 0x31, 0x7E	};
-static const uint8_t key_del[]		= { 0x1B, 0x5B, 0x33, 0x7E	};
-static const uint8_t key_end[]		= { 0x1B, 0x5B, 0x34, 0x7E	};
-static const uint8_t key_pgup[]		= { 0x1B, 0x5B, 0x35, 0x7E	};
-static const uint8_t key_pgdn[]		= { 0x1B, 0x5B, 0x36, 0x7E	};
-static const uint8_t key_arrowup[]	= { 0x1B, 0x5B, 0x41		};
-static const uint8_t key_arrowdn[]	= { 0x1B, 0x5B, 0x42		};
-static const uint8_t key_arrowrt[]	= { 0x1B, 0x5B, 0x43		};
-static const uint8_t key_arrowlt[]	= { 0x1B, 0x5B, 0x44		};
-static const uint8_t key_bksp_del[]	= { 0x7F			};
-
-// Table of special keys. We could store this in PROGMEM, but we don't,
-// because the code to retrieve the data is much larger than the savings.
-// Scancode 127 (DEL) is deliberately remapped to BKSP. Some terminals will
-// send DEL instead of BKSP and vice versa, so treat them as aliases.
-static const struct key {
-	const uint8_t	*code;
-	uint8_t		 len;
-	enum keytype	 type;
-}
-keys[] = {
-	{ key_bksp,	sizeof(key_bksp),	KEY_BKSP	},
-	{ key_enter,	sizeof(key_enter),	KEY_ENTER	},
-	{ key_home,	sizeof(key_home),	KEY_HOME	},
-	{ key_del,	sizeof(key_del),	KEY_DEL		},
-	{ key_end,	sizeof(key_end),	KEY_END		},
-	{ key_pgup,	sizeof(key_pgup),	KEY_PGUP	},
-	{ key_pgdn,	sizeof(key_pgdn),	KEY_PGDN	},
-	{ key_arrowup,	sizeof(key_arrowup),	KEY_ARROWUP	},
-	{ key_arrowdn,	sizeof(key_arrowdn),	KEY_ARROWDN	},
-	{ key_arrowrt,	sizeof(key_arrowrt),	KEY_ARROWRT	},
-	{ key_arrowlt,	sizeof(key_arrowlt),	KEY_ARROWLT	},
-	{ key_bksp_del,	sizeof(key_bksp_del),	KEY_BKSP	},
+#ifdef READLINE_STATS
+// Bytes emitted per key type, to compare redraw strategies.
+static const char PROGMEM key_names[][6] = {
+	"none", "char", "bksp", "tab", "enter", "home", "del", "end",
+	"pgup", "pgdn", "up", "down", "right", "left",
+	"kend", "kbeg", "kword",
 };
 
+static struct {
+	uint16_t keys;
+	uint16_t bytes;
+} stats[NELEM(key_names)];
+
+static enum keytype stats_key;
+#endif
+
+// Key decoder states.
+enum state {
+	STATE_GROUND,
+	STATE_ESC,	// After ESC
+	STATE_CSI,	// After ESC [
+	STATE_SS3,	// After ESC O
+};
+
+// Keys for C0 control characters, emacs-style.
+static const uint8_t PROGMEM ctrl_keys[0x20] = {
+	[0x01] = KEY_HOME,		// Ctrl-A
+	[0x02] = KEY_ARROWLT,		// Ctrl-B
+	[0x04] = KEY_DEL,		// Ctrl-D
+	[0x05] = KEY_END,		// Ctrl-E
+	[0x06] = KEY_ARROWRT,		// Ctrl-F
+	[0x08] = KEY_BKSP,		// Ctrl-H
+	[0x09] = KEY_TAB,		// Ctrl-I
+	[0x0B] = KEY_KILL_END,		// Ctrl-K
+	[0x0D] = KEY_ENTER,		// Ctrl-M
+	[0x0E] = KEY_ARROWDN,		// Ctrl-N
+	[0x10] = KEY_ARROWUP,		// Ctrl-P
+	[0x15] = KEY_KILL_START,	// Ctrl-U
+	[0x17] = KEY_KILL_WORD,		// Ctrl-W
+};
+
+// Keys for the final byte of ESC [ x and ESC O x sequences, from 'A'. The
+// xterm forms, optionally with modifiers like ESC [ 1 ; 5 C.
+static const uint8_t PROGMEM final_keys['Z' - 'A' + 1] = {
+	['A' - 'A'] = KEY_ARROWUP,
+	['B' - 'A'] = KEY_ARROWDN,
+	['C' - 'A'] = KEY_ARROWRT,
+	['D' - 'A'] = KEY_ARROWLT,
+	['F' - 'A'] = KEY_END,
+	['H' - 'A'] = KEY_HOME,
+};
+
+// Keys for the VT forms ESC [ n ~, by n. Both the VT220 and rxvt codes for
+// Home and End.
+static const uint8_t PROGMEM tilde_keys[] = {
+	[1] = KEY_HOME,
+	[3] = KEY_DEL,
+	[4] = KEY_END,
+	[5] = KEY_PGUP,
+	[6] = KEY_PGDN,
+	[7] = KEY_HOME,
+	[8] = KEY_END,
+};
+
+// Wait for the next byte of an escape sequence. Returns false on timeout.
 static bool
-key_matches (const uint8_t c, const int8_t idx, const int8_t pos)
+wait_byte (void)
 {
-	// If key is too short, skip:
-	if (pos >= keys[idx].len)
-		return false;
+	const uint32_t deadline = clock_now32() + CLOCK_US_TICKS(ESC_TIMEOUT_MS * 1000UL);
+
+	while (!uart_rx_ready())
+		if (clock_sleep(deadline))
+			return false;
 
-	// Character must match:
-	return (c == keys[idx].code[pos]);
+	return true;
 }
 
-static bool
-find_key (const uint8_t c, int8_t *idx, const int8_t pos)
+// Decode a character outside of an escape sequence.
+static enum keytype
+plain_key (const uint8_t c, uint8_t *val)
 {
-	// If character matches current index, return:
-	if (c == keys[*idx].code[pos])
-		return true;
-
-	// If character is less than current index, seek up:
-	if (c < keys[*idx].code[pos]) {
-		for (int8_t i = *idx - 1; i >= 0; i--) {
-			if (key_matches(c, i, pos)) {
-				*idx = i;
-				return true;
-			}
-		}
-		return false;
-	}
+	// DEL is an alias for BKSP, because some terminals send DEL instead
+	// of BKSP and vice versa.
+	if (c == 0x7F)
+		return KEY_BKSP;
 
-	// If character is greater than current index, seek down:
-	else {
-		for (int8_t i = *idx + 1; i < NELEM(keys); i++) {
-			if (key_matches(c, i, pos)) {
-				*idx = i;
-				return true;
-			}
-		}
-		return false;
-	}
+	if (c < 0x20)
+		return pgm_read_byte(&ctrl_keys[c]);
+
+	*val = c;
+	return KEY_REGULAR;
+}
+
+// Decode a final byte of an escape sequence.
+static enum keytype
+final_key (const uint8_t c)
+{
+	return (c >= 'A' && c <= 'Z')
+		? pgm_read_byte(&final_keys[c - 'A'])
+		: KEY_NONE;
 }
 
-// Get the next key from the UART.
+// Get the next key from the UART. A state machine that takes one step per
+// byte, with its output in flash.
 static enum keytype
 next_key (uint8_t *val)
 {
-	static int8_t idx, pos;
+	enum state state = STATE_GROUND;
+	uint8_t param = 0;
+	bool more = false;
 
 	for (;;) {
 
+		// Inside a sequence, drop it if the rest is late.
+		if (state != STATE_GROUND && !wait_byte())
+			return KEY_NONE;
+
 		// Get the next character from the UART (blocking).
 		const uint8_t c = uart_getchar();
 
-		// Try to find a matching key from the special keys table.
-		if (find_key(c, &idx, pos)) {
+		switch (state) {
+		case STATE_GROUND:
+			if (c != 0x1B)
+				return plain_key(c, val);
+
+			state = STATE_ESC;
+			break;
+
+		case STATE_ESC:
+			if (c == '[')
+				state = STATE_CSI;
+			else if (c == 'O')
+				state = STATE_SS3;
+
+			// An Alt-modified key: drop the ESC.
+			else if (c != 0x1B)
+				return plain_key(c, val);
+
+			break;
+
+		case STATE_CSI:
+			// Collect the first parameter, skip the others. Stop
+			// before it overflows: any value past the tilde keys
+			// decodes to no key.
+			if (c >= '0' && c <= '9') {
+				if (!more && param < 25)
+					param = param * 10 + (c - '0');
+
+				break;
+			}
+
+			if (c == ';') {
+				more = true;
+				break;
+			}
+
+			if (c == '~')
+				return (param < NELEM(tilde_keys))
+					? pgm_read_byte(&tilde_keys[param])
+					: KEY_NONE;
+
+			// Skip other parameter and intermediate bytes.
+			if (c >= 0x20 && c < 0x40)
+				break;
+
+			return final_key(c);
+
+		case STATE_SS3:
+			return final_key(c);
+		}
+	}
+}
+
+// Find the start of a history line, counting from 0 for the newest.
+static uint8_t
+hist_find (uint8_t n)
+{
+	const uint8_t oldest = (hhead - hused) & HISTMASK;
+	uint8_t p = hhead;
+
+	do {
+		// Step back onto the terminator, then to the start of the line.
+		p = (p - 1) & HISTMASK;
+		while (p != oldest && hist[(p - 1) & HISTMASK] != '\0')
+			p = (p - 1) & HISTMASK;
+	} while (n--);
+
+	return p;
+}
+
+// Check if the line equals the newest history line.
+static bool
+hist_repeat (void)
+{
+	if (hcount == 0)
+		return false;
+
+	for (uint8_t i = 0, p = hist_find(0); i <= llen; i++, p = (p + 1) & HISTMASK)
+		if (hist[p] != line[i])
+			return false;
+
+	return true;
+}
+
+// Save the zero-terminated line to history.
+static void
+hist_add (void)
+{
+	if (llen == 0 || hist_repeat())
+		return;
+
+	// Evict the oldest lines until the new one fits.
+	while (hused + llen + 1 > HISTSIZE) {
+		uint8_t p = (hhead - hused) & HISTMASK;
+
+		while (hist[p] != '\0') {
+			p = (p + 1) & HISTMASK;
+			hused--;
+		}
+		hused--;
+		hcount--;
+	}
+
+	for (uint8_t i = 0; i <= llen; i++) {
+		hist[hhead] = line[i];
+		hhead = (hhead + 1) & HISTMASK;
+	}
+
+	hused += llen + 1;
+	hcount++;
+}
+
+static void
+emit (const char *s, const uint8_t n)
+{
+	uart_write(s, n);
+
+#ifdef READLINE_STATS
+	stats[stats_key].bytes += n;
+#endif
+}
+
+static void
+emitc (const char c)
+{
+	emit(&c, 1);
+}
+
+// Size of a control sequence with a count. A count of one is implied.
+static inline uint8_t
+csi_size (const uint8_t n)
+{
+	return n == 1 ? 3 : n < 10 ? 4 : 5;
+}
+
+// Emit a control sequence with a count: ESC [ n c.
+static void
+csi (uint8_t n, const char c)
+{
+	char buf[5] = { 0x1B, '[' };
+	uint8_t len = 2;
+
+	if (n >= 10) {
+		buf[len] = '0';
+		for (; n >= 10; n -= 10)
+			buf[len]++;
+		len++;
+	}
+
+	if (n > 1 || len > 2)
+		buf[len++] = '0' + n;
+
+	buf[len++] = c;
+	emit(buf, len);
+}
+
+// Size of the cheapest cursor movement over n columns.
+static uint8_t
+move_size (const uint8_t from, const uint8_t to)
+{
+	const uint8_t n = (to < from) ? from - to : to - from;
+
+	return (ansi && csi_size(n) < n) ? csi_size(n) : n;
+}
+
+// Move the cursor. Moving right reprints the characters in between, which
+// the terminal must already show.
+static void
+move (const uint8_t to)
+{
+	if (to < scol) {
+		const uint8_t n = scol - to;
+
+		if (ansi && csi_size(n) < n)
+			csi(n, 'D');
+		else
+			for (uint8_t i = 0; i < n; i++)
+				emitc('\b');
+	}
+	else if (to > scol) {
+		const uint8_t n = to - scol;
+
+		if (ansi && csi_size(n) < n)
+			csi(n, 'C');
+		else
+			emit(line + scol, n);
+	}
+
+	scol = to;
+}
+
+// Bring the terminal up to date after an edit that replaced `removed`
+// characters at column `at` with `inserted` new ones, and leave the cursor
+// at lpos. Repaints the rest of the line, or, on ANSI terminals, inserts
+// or deletes characters in place, whichever takes fewer bytes.
+static void
+refresh (const uint8_t at, const uint8_t removed, const uint8_t inserted)
+{
+	const uint8_t tail = llen - at - inserted;
+	const uint8_t diff = (inserted > removed) ? inserted - removed : removed - inserted;
 
-			// If we are at max length, we're done.
-			if (++pos == keys[idx].len) {
-				const enum keytype ret = keys[idx].type;
-				idx = pos = *val = 0;
-				return ret;
+	move(at);
+
+	// Splice: overwrite the changed characters, and insert (ICH) or
+	// delete (DCH) the difference. Only worth it with a tail to save.
+	if (ansi && tail && diff) {
+		const uint8_t paint  = llen - at + (slen > llen ? 3 : 0) + move_size(llen, lpos);
+		const uint8_t splice = inserted + csi_size(diff) + move_size(at + inserted, lpos);
+
+		if (splice < paint) {
+			const uint8_t keep = (inserted < removed) ? inserted : removed;
+
+			emit(line + at, keep);
+			if (inserted > removed) {
+				csi(diff, '@');
+				emit(line + at + keep, diff);
 			}
+			else
+				csi(diff, 'P');
 
-			// Otherwise, need more input to be certain.
-			continue;
+			scol = at + inserted;
+			slen = llen;
+			move(lpos);
+			return;
 		}
+	}
 
-		// No matching special key: it's a regular character.
-		idx = pos = 0;
-		*val = c;
-		return KEY_REGULAR;
+	// Repaint: print the rest of the line, and clear what remains of
+	// the old one, with CSI K or with spaces.
+	emit(line + at, llen - at);
+	scol = llen;
+
+	if (slen > llen) {
+		if (ansi)
+			csi(1, 'K');
+		else
+			for (; scol < slen; scol++)
+				emitc(' ');
 	}
+
+	slen = llen;
+	move(lpos);
 }
 
+// Replace the line with a history line, or the scratch line for zero.
+static void
+hist_load (const uint8_t sel)
+{
+	const uint8_t old = llen;
+	uint8_t at = 0, p = (sel > 0) ? hist_find(sel - 1) : 0;
+	char c;
+
+	llen = 0;
+
+	// Copy the line, finding the prefix that stays the same. The scratch
+	// line is shorter than the ring, so the wraparound never applies.
+	while ((c = (sel > 0) ? hist[p] : scratch[p]) != '\0') {
+		if (at == llen && llen < old && line[llen] == c)
+			at++;
+
+		line[llen++] = c;
+		p = (p + 1) & HISTMASK;
+	}
+
+	// Leave the cursor at the end.
+	lpos = llen;
+	hsel = sel;
+	refresh(at, old - at, llen - at);
+}
+
+// Insert characters at the cursor, as far as they fit.
+static void
+insert (const char *s, uint8_t n)
+{
+	if (n > LINESIZE - llen)
+		n = LINESIZE - llen;
+
+	if (n == 0)
+		return;
+
+	// If there is string to the right, move it over:
+	for (int8_t i = llen - 1; i >= lpos; i--)
+		line[i + n] = line[i];
+
+	// Insert characters:
+	for (uint8_t i = 0; i < n; i++)
+		line[lpos + i] = s[i];
+
+	lpos += n;
+	llen += n;
+	refresh(lpos - n, 0, n);
+}
+
+// Remove characters at a position.
+static void
+delete (const uint8_t at, const uint8_t n)
+{
+	for (uint8_t i = at; i + n < llen; i++)
+		line[i] = line[i + n];
+
+	llen -= n;
+	lpos  = at;
+	refresh(at, n, 0);
+}
+
+// Complete the word before the cursor. A second Tab that follows a Tab
+// which completed nothing lists the candidates.
+static bool
+complete (const bool list)
+{
+	char buf[LINESIZE];
+
+	if (completer == NULL)
+		return false;
+
+	const int8_t n = completer(line, lpos, buf, LINESIZE - llen, list);
+
+	// The candidates were listed, so redraw the line after the new prompt.
+	if (n < 0) {
+		slen = scol = 0;
+		refresh(0, 0, llen);
+		return false;
+	}
+
+	insert(buf, n);
+	return n == 0;
+}
+
+// Set the tab completion function.
+void
+readline_complete (readline_completer fn)
+{
+	completer = fn;
+}
+
+// Select ANSI cursor control, or plain backspaces for dumb terminals.
+void
+readline_ansi (const bool on)
+{
+	ansi = on;
+}
+
+bool
+readline_is_ansi (void)
+{
+	return ansi;
+}
+
+#ifdef READLINE_STATS
+// Print the number of keys and emitted bytes per key type.
+void
+readline_stats_print (void)
+{
+	static const char PROGMEM fmt[] = "%p\t%u\t%u\n";
+
+	uart_printf_P(PSTR("key\tkeys\tbytes\n"));
+	for (uint8_t i = 0; i < NELEM(stats); i++)
+		if (stats[i].keys)
+			uart_printf_P(fmt, key_names[i], stats[i].keys, stats[i].bytes);
+}
+
+void
+readline_stats_reset (void)
+{
+	memset(stats, 0, sizeof (stats));
+}
+#endif
+
 // Take characters from the Rx FIFO and create a line.
 char *
 readline (void)
 {
 	uint8_t val;
+	bool tab = false;
 
 	for (;;) {
-		switch (next_key(&val)) {
-		case KEY_REGULAR:
-			// Refuse insert if we are at the end of the line:
-			if (lpos == LINESIZE)
-			       break;
-
-			// If there is string to the right, move it over one place:
-			if (llen > lpos)
-				for (int8_t i = llen; i >= lpos; i--)
-					line[lbuf][i + 1] = line[lbuf][i];
-
-			// Insert character:
-			line[lbuf][lpos++] = val;
+		const enum keytype key = next_key(&val);
+		PROBE_SCOPE(READLINE_KEY);
 
-			// Increase line length, if possible:
-			if (llen < LINESIZE)
-				llen++;
+		// Track whether the previous key was a fruitless Tab.
+		if (key != KEY_TAB)
+			tab = false;
 
-			// Paint new string:
-			for (int8_t i = lpos - 1; i < llen; i++)
-				uart_putc(line[lbuf][i]);
+#ifdef READLINE_STATS
+		stats_key = key;
+		stats[key].keys++;
+#endif
 
-			// Backtrack to current position:
-			for (int8_t i = lpos; i < llen; i++)
-				uart_putc('\b');
+		switch (key) {
+		case KEY_TAB:
+			tab = complete(tab);
+			break;
 
+		case KEY_REGULAR:
+			insert((const char *) &val, 1);
 			break;
 
 		case KEY_BKSP:
-			// Nothing to do if we are at the start of the line:
-			if (lpos == 0)
-				break;
+			if (lpos > 0)
+				delete(lpos - 1, 1);
 
-			// Line becomes one character shorter:
-			llen--;
-			lpos--;
-
-			uart_putc('\b');
-
-			// Move characters one over to the left:
-			for (int8_t i = lpos; i < llen; i++) {
-				line[lbuf][i] = line[lbuf][i + 1];
-				uart_putc(line[lbuf][i]);
-			}
-			uart_putc(' ');
+			break;
 
-			// Backtrack to current position:
-			for (int8_t i = lpos; i <= llen; i++)
-				uart_putc('\b');
+		case KEY_DEL:
+			if (lpos < llen)
+				delete(lpos, 1);
 
 			break;
 
 		case KEY_ENTER:
-			// Zero-terminate the line, so that we can find the end
-			// if we move back to this line.
-			line[lbuf][llen] = '\0';
-
-			// Copy this null-terminated line to the output buf.
-			for (uint8_t i = 0; i <= llen; i++)
-				outbuf[i] = line[lbuf][i];
-
-			// If the line is not empty, reset the line position
-			// and swap the buffers. This saves the line to
-			// history. Empty lines are not remembered/swapped.
-			if (llen) {
-				llen = lpos = 0;
-				lbuf ^= 1;
-			}
+			// Zero-terminate the line, and save it to history.
+			line[llen] = '\0';
+			hist_add();
 
-			// Return the output buffer to the caller.
-			return outbuf;
+			// Start afresh on the next call. The caller gets the
+			// line buffer itself, which stays untouched until then.
+			llen = lpos = hsel = 0;
+			slen = scol = 0;
+			return line;
 
 		case KEY_HOME:
-			while (lpos) {
-				uart_putc('\b');
-				lpos--;
-			}
+			move(lpos = 0);
 			break;
 
-		case KEY_DEL:
-			// Nothing to do if we are at the end of the line:
-			if (lpos == llen)
-				break;
+		case KEY_END:
+			move(lpos = llen);
+			break;
 
-			llen--;
+		case KEY_KILL_END:
+			if (lpos < llen)
+				delete(lpos, llen - lpos);
 
-			// Move characters one over to the left:
-			for (uint8_t i = lpos; i < llen; i++) {
-				line[lbuf][i] = line[lbuf][i + 1];
-				uart_putc(line[lbuf][i]);
-			}
-			uart_putc(' ');
+			break;
 
-			// Backtrack to current position:
-			for (int8_t i = lpos; i <= llen; i++)
-				uart_putc('\b');
+		case KEY_KILL_START:
+			if (lpos > 0)
+				delete(0, lpos);
 
 			break;
 
-		case KEY_END:
-			while (lpos < llen)
-				uart_putc(line[lbuf][lpos++]);
+		case KEY_KILL_WORD: {
+			uint8_t at = lpos;
+
+			// Kill spaces, then the word before them.
+			while (at > 0 && line[at - 1] == ' ')
+				at--;
+
+			while (at > 0 && line[at - 1] != ' ')
+				at--;
+
+			if (at < lpos)
+				delete(at, lpos - at);
 
 			break;
+		}
 
+		case KEY_NONE:
 		case KEY_PGUP:
 		case KEY_PGDN:
 			break;
 
-		case KEY_ARROWDN:
 		case KEY_ARROWUP:
-			// Backtrack from the cursor to the start of the line.
-			for (uint8_t i = 0; i < lpos; i++)
-				uart_putc('\b');
-
-			// Blank the current line.
-			for (uint8_t i = 0; i < llen; i++)
-				uart_putc(' ');
-
-			// Backtrack to the start of the line again.
-			for (uint8_t i = 0; i < llen; i++)
-				uart_putc('\b');
+			// Keep the line being typed for the way back down.
+			if (hsel == 0) {
+				memcpy(scratch, line, llen);
+				scratch[llen] = '\0';
+			}
 
-			// Zero-terminate the line, so that we can find the end
-			// if we move back to this line.
-			line[lbuf][llen] = '\0';
+			if (hsel < hcount)
+				hist_load(hsel + 1);
 
-			// Swap the buffers.
-			lbuf ^= 1;
+			break;
 
-			// Print the new line, leaving the cursor at the end.
-			for (llen = 0, lpos = 0; line[lbuf][llen] != '\0'; llen++)
-				uart_putc(line[lbuf][lpos++]);
+		case KEY_ARROWDN:
+			if (hsel > 0)
+				hist_load(hsel - 1);
 
 			break;
 
 		case KEY_ARROWRT:
 			if (lpos < llen)
-				uart_putc(line[lbuf][lpos++]);
+				move(++lpos);
 
 			break;
 
 		case KEY_ARROWLT:
-			if (lpos == 0)
-				break;
+			if (lpos > 0)
+				move(--lpos);
 
-			uart_putc('\b');
-			lpos--;
 			break;
 		}
 	}
@@ -1 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Tab completion function. Gets the line up to the cursor, writes the text
+// to insert into buf, and returns its length. If list is set, it may print
+// the candidates and a new prompt, and return -1 to have the line redrawn.
+typedef int8_t (* readline_completer) (const char *line, const uint8_t len, char *buf, const uint8_t size, const bool list);
+
+extern void readline_complete (readline_completer fn);
+extern void readline_ansi (const bool on);
+extern bool readline_is_ansi (void);
+extern void readline_stats_print (void);
+extern void readline_stats_reset (void);
 extern char *readline (void);
@@ -1,105 +1,299 @@
 #include <stddef.h>
 #include <avr/io.h>
-#include <util/delay.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 
+#include "clock.h"
+#include "probe.h"
 #include "si4735.h"
 #include "si4735_cmd.h"
+#include "spi.h"
+#include "util.h"
 
 #define PIN_POWER	PORTB0
 #define PIN_RESET	PORTB1
 
-// Redefine ports as used in SPI:
-#define PIN_SS		PORTB2
-#define PIN_MOSI	PORTB3
-#define PIN_MISO	PORTB4
-#define PIN_SCK		PORTB5
+// The chip's GPO2/INT line is wired to INT0:
+#define PIN_INT		PORTD2
 
 // Chip commands:
 #define CMD_WRITE	0x48
 #define CMD_READ_SHORT	0xA0
 #define CMD_READ_LONG	0xE0
 
+// By default, the driver polls the chip's Clear To Send bit to find out when
+// a response is ready. Building with SI4735_FIXED_DELAYS falls back to fixed,
+// conservative settle delays instead.
+#ifndef SI4735_FIXED_DELAYS
+
+// Upper bound on status polls while waiting for CTS. One poll takes a few
+// dozen microseconds, the slowest commands take about 10 ms.
+#define CTS_POLLS	1000
+#endif
+
+// Time limits for the chip to power up, and to complete a tune, in
+// milliseconds. Powerup takes 110 ms, a tune well under 100 ms.
+#ifndef SI4735_POWER_UP_MS
+#define SI4735_POWER_UP_MS	500
+#endif
+
+#ifndef SI4735_TUNE_MS
+#define SI4735_TUNE_MS		500
+#endif
+
+// Argument and response lengths per command. Writes are always clocked out
+// as a full frame of a command byte and seven arguments, because the chip
+// only executes a command once it has received the whole frame; unused
+// arguments are zero-filled. Long reads stop after the last response byte
+// of the command, instead of clocking out all sixteen bytes.
+static const struct cmd_len {
+	uint8_t cmd;
+	uint8_t args;	// Number of argument bytes
+	uint8_t resp;	// Response bytes, including the status byte
+}
+PROGMEM cmd_len[] = {
+	{ SI4735_CMD_POWER_UP,		2,  1 },
+	{ SI4735_CMD_GET_REV,		0,  9 },
+	{ SI4735_CMD_POWER_DOWN,	0,  1 },
+	{ SI4735_CMD_SET_PROPERTY,	5,  1 },
+	{ SI4735_CMD_GET_PROPERTY,	3,  4 },
+	{ SI4735_CMD_GET_INT_STATUS,	0,  1 },
+	{ SI4735_CMD_FM_TUNE_FREQ,	4,  1 },
+	{ SI4735_CMD_FM_SEEK_START,	1,  1 },
+	{ SI4735_CMD_FM_TUNE_STATUS,	1,  8 },
+	{ SI4735_CMD_FM_RSQ_STATUS,	1,  8 },
+	{ SI4735_CMD_FM_RDS_STATUS,	1, 13 },
+	{ SI4735_CMD_AM_TUNE_FREQ,	5,  1 },
+	{ SI4735_CMD_AM_SEEK_START,	5,  1 },
+	{ SI4735_CMD_AM_TUNE_STATUS,	1,  8 },
+	{ SI4735_CMD_AM_RSQ_STATUS,	1,  6 },
+};
+
+// Size of the write and long read frames, excluding the prefix byte.
+#define FRAME_WRITE	8
+#define FRAME_READ	16
+
+// Index into the length table of the last command written. Points past the
+// end of the table for unknown commands.
+static uint8_t last_cmd;
+
+#ifdef SI4735_STATS
+static struct si4735_stats stats[NELEM(cmd_len)];
+#endif
+
 // Chip bootup mode.
 static enum si4735_mode mode = SI4735_MODE_DOWN;
 
-static inline void
-bswap16 (uint16_t *n)
+// Set when the chip pulses its interrupt line. Cleared before issuing a
+// command whose completion is signalled through the interrupt.
+static volatile bool irq;
+
+// Set along with the above, but only cleared when checked for RDS data.
+static volatile bool irq_rds;
+
+// Incremented on every power up, power down, tune and seek.
+static uint8_t tune_count;
+
+// Maximum age of cached status, in milliseconds.
+#ifndef SI4735_CACHE_MS
+#define SI4735_CACHE_MS	1000
+#endif
+
+// Cached copies of the last tune and RSQ status. An entry is valid for the
+// tune count it was read at, until it exceeds the maximum age.
+static struct {
+	struct si4735_tune_status tune;
+	struct si4735_rsq_status  rsq;
+	uint32_t tune_at;
+	uint32_t rsq_at;
+	uint8_t  tune_count;
+	uint8_t  rsq_count;
+	bool     tune_valid;
+	bool     rsq_valid;
+} cache;
+
+ISR (INT0_vect)
 {
-	*n = __builtin_bswap16(*n);
+	irq     = true;
+	irq_rds = true;
 }
 
-static inline void
-slave_select (void)
+// Sleep until the chip pulses its interrupt line. Returns false if that did
+// not happen by the given clock time.
+static bool
+irq_wait (const uint32_t until)
+{
+	bool late = false;
+
+	for (;;) {
+
+		// Check atomically if the flag is set.
+		cli();
+		if (irq) {
+			irq = false;
+			sei();
+			return true;
+		}
+
+		if (late) {
+			sei();
+			return false;
+		}
+
+		// Sleep until woken by an interrupt or the deadline. Checks
+		// the flag once more after the deadline.
+		late = clock_sleep(until);
+	}
+}
+
+// Get the clock time the given number of milliseconds from now.
+static uint32_t
+deadline (const uint16_t ms)
 {
-	PORTB &= ~_BV(PIN_SS);
-	_delay_us(100);
+	return clock_now32() + CLOCK_US_TICKS(ms * 1000UL);
 }
 
 static inline void
-slave_unselect (void)
+bswap16 (uint16_t *n)
 {
-	PORTB |= _BV(PIN_SS);
+	*n = __builtin_bswap16(*n);
 }
 
+// Find a command in the length table.
 static uint8_t
-spi_xfer (uint8_t c)
+cmd_find (const uint8_t cmd)
 {
-	SPDR = c;
+	uint8_t i;
 
-	while (!(SPSR & _BV(SPIF)))
-		continue;
+	for (i = 0; i < NELEM(cmd_len); i++)
+		if (pgm_read_byte(&cmd_len[i].cmd) == cmd)
+			break;
 
-	return SPDR;
+	return i;
 }
 
+// Queue a command for transmission. Does not wait for completion, so the
+// caller can do other work while the bytes are clocked out. The command
+// buffer must stay untouched until the next read.
 static void
 write (const uint8_t *cmd, uint8_t len)
 {
-	slave_select();
+	static struct spi_xfer x = {
+		.prefix = CMD_WRITE,
+		.PREFIX = 1,
+	};
 
-	// Send prefix:
-	spi_xfer(CMD_WRITE);
+	// Wait for a previous write to finish before reusing the transaction:
+	spi_wait(&x);
 
-	// Write command:
-	for (uint8_t i = 0; i < len; i++)
-		spi_xfer(cmd[i]);
+	// Never send more than the command's arguments:
+	if ((last_cmd = cmd_find(cmd[0])) < NELEM(cmd_len)) {
+		const uint8_t max = 1 + pgm_read_byte(&cmd_len[last_cmd].args);
+
+		if (len > max)
+			len = max;
+	}
 
-	// Zero-fill remainder:
-	for (uint8_t i = len; i < 8; i++)
-		spi_xfer(0x00);
+	// Zero-fill the remainder of the frame:
+	x.tx   = cmd;
+	x.len  = len;
+	x.fill = FRAME_WRITE - len;
 
-	slave_unselect();
+	spi_submit(&x);
+
+#ifdef SI4735_STATS
+	if (last_cmd < NELEM(cmd_len)) {
+		stats[last_cmd].calls++;
+		stats[last_cmd].bytes += 1 + FRAME_WRITE;
+	}
+#endif
 }
 
 // Read short response from chip:
 static struct si4735_status
 read_status (void)
 {
-	slave_select();
-	spi_xfer(CMD_READ_SHORT);
-	const struct si4735_status status = { .raw = spi_xfer(0x00) };
-	slave_unselect();
+	static struct si4735_status status;
+	static struct spi_xfer x = {
+		.rx     = &status.raw,
+		.prefix = CMD_READ_SHORT,
+		.len    = 1,
+		.PREFIX = 1,
+	};
+
+	spi_submit(&x);
+	spi_wait(&x);
 	return status;
 }
 
+// Wait for the chip to finish the last command. Returns false on error.
+static bool
+reply_ok (void)
+{
+#ifdef SI4735_FIXED_DELAYS
+	return !read_status().ERR;
+#else
+	for (uint16_t i = 0; i < CTS_POLLS; i++) {
+		const struct si4735_status status = read_status();
+
+		if (status.CTS)
+			return !status.ERR;
+	}
+
+	// Timed out:
+	return false;
+#endif
+}
+
 // Read long response from chip:
 static bool
 read_long (uint8_t *buf, uint8_t len)
 {
-	slave_select();
+	static struct spi_xfer cmd = {
+		.prefix = CMD_READ_LONG,
+		.PREFIX = 1,
+		.HOLD   = 1,
+	};
+	static struct spi_xfer data;
+
+#ifdef SI4735_FIXED_DELAYS
+	// Send the prefix and keep the slave selected while the chip
+	// prepares its response:
+	spi_submit(&cmd);
+	spi_wait(&cmd);
+	clock_delay(300);
+#else
+	// Wait until the response is ready, then queue the prefix and the
+	// response read back to back:
+	if (!reply_ok())
+		return false;
 
-	spi_xfer(CMD_READ_LONG);
-	_delay_us(300);
+	spi_submit(&cmd);
+#endif
+
+	// Clock out no more than the command's response:
+	if (last_cmd < NELEM(cmd_len)) {
+		const uint8_t max = pgm_read_byte(&cmd_len[last_cmd].resp);
+
+		if (len > max)
+			len = max;
+	}
 
 	// Save response bytes into caller-supplied buffer:
-	for (uint8_t i = 0; i < len; i++)
-		buf[i] = spi_xfer(0x00);
+	data.rx  = buf;
+	data.len = len;
 
-	// Pad to 16 bytes transferred:
-	for (uint8_t i = len; i < 16; i++)
-		spi_xfer(0x00);
+	spi_submit(&data);
+	spi_wait(&data);
 
-	slave_unselect();
+#ifdef SI4735_STATS
+	if (last_cmd < NELEM(cmd_len)) {
+		stats[last_cmd].bytes += 1 + len;
+		stats[last_cmd].saved += FRAME_READ - len;
+		stats[last_cmd].ticks += cmd.ticks + data.ticks;
+	}
+#endif
 
 	// Return error status:
 	return !(buf[0] & 0x40);
@@ -125,6 +319,7 @@ si4735_freq_set (const uint16_t freq, const bool fast, const bool freeze, const
 		uint16_t antcap;		// 8-bit in FM mode
 	} c;
 	size_t size;
+	PROBE_SCOPE(SI4735_FREQ_SET);
 
 	switch (mode) {
 	case SI4735_MODE_FM:
@@ -155,8 +350,10 @@ si4735_freq_set (const uint16_t freq, const bool fast, const bool freeze, const
 
 	c.freq  = __builtin_bswap16(freq);
 
+	tune_count++;
+	irq = false;
 	write(&c.cmd, size);
-	return !read_status().ERR;
+	return reply_ok();
 }
 
 bool
@@ -176,6 +373,7 @@ si4735_seek_start (const bool up, const bool wrap, const bool sw)
 		} am;
 	} c;
 	size_t size;
+	PROBE_SCOPE(SI4735_SEEK_START);
 
 	switch (mode) {
 	case SI4735_MODE_FM:
@@ -202,8 +400,10 @@ si4735_seek_start (const bool up, const bool wrap, const bool sw)
 	c.WRAP   = wrap;
 	c.SEEKUP = up;
 
+	tune_count++;
+	irq = false;
 	write(&c.cmd, size);
-	return !read_status().ERR;
+	return reply_ok();
 }
 
 static bool
@@ -233,6 +433,9 @@ tune_status (struct si4735_tune_status *buf, const bool cancel_seek)
 
 	c.CANCEL = cancel_seek;
 
+	if (cancel_seek)
+		irq = false;
+
 	write(&c.cmd, sizeof (c));
 	return read_long((uint8_t *) buf, sizeof (*buf));
 }
@@ -240,6 +443,8 @@ tune_status (struct si4735_tune_status *buf, const bool cancel_seek)
 bool
 si4735_tune_status (struct si4735_tune_status *buf)
 {
+	PROBE_SCOPE(SI4735_TUNE_STATUS);
+
 	if (!tune_status(buf, false))
 		return false;
 
@@ -247,6 +452,35 @@ si4735_tune_status (struct si4735_tune_status *buf)
 		bswap16(&buf->am.readantcap);
 
 	bswap16(&buf->freq);
+
+	// Cache the status once the tune or seek has completed. Until then,
+	// the frequency is still moving.
+	if ((cache.tune_valid = buf->status.STCINT)) {
+		cache.tune       = *buf;
+		cache.tune_at    = clock_now32();
+		cache.tune_count = tune_count;
+	}
+
+	return true;
+}
+
+// Check if a cache entry is still valid.
+static bool
+cache_fresh (const bool valid, const uint8_t count, const uint32_t at)
+{
+	return valid
+	    && count == tune_count
+	    && clock_now32() - at < CLOCK_US_TICKS(SI4735_CACHE_MS * 1000UL);
+}
+
+// Get the tune status from the cache if possible, else from the chip.
+bool
+si4735_tune_status_cached (struct si4735_tune_status *buf)
+{
+	if (!cache_fresh(cache.tune_valid, cache.tune_count, cache.tune_at))
+		return si4735_tune_status(buf);
+
+	*buf = cache.tune;
 	return true;
 }
 
@@ -254,10 +488,89 @@ bool
 si4735_seek_cancel (void)
 {
 	struct si4735_tune_status buf;
+	PROBE_SCOPE(SI4735_SEEK_CANCEL);
 
 	return tune_status(&buf, true);
 }
 
+// Sleep until the Seek/Tune Complete interrupt is set. Gives up when a
+// tune takes too long.
+bool
+si4735_stc_wait (void)
+{
+	const uint32_t until = deadline(SI4735_TUNE_MS);
+	PROBE_SCOPE(SI4735_STC_WAIT);
+
+	for (;;) {
+		const struct si4735_status status = read_status();
+
+		if (status.ERR)
+			return false;
+
+		if (status.STCINT)
+			return true;
+
+		if (!irq_wait(until))
+			return false;
+	}
+}
+
+// Get the number of times the chip was powered up or down or (re)tuned.
+// Allows callers to notice when data about the current station went stale.
+uint8_t
+si4735_tune_count (void)
+{
+	return tune_count;
+}
+
+// Check and clear whether the chip signalled an interrupt since the last
+// call, which may have been for RDS data.
+bool
+si4735_rds_pending (void)
+{
+	bool pending;
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		pending = irq_rds;
+		irq_rds = false;
+	}
+
+	return pending;
+}
+
+// Read and remove the oldest group from the RDS FIFO.
+bool
+si4735_rds_status (struct si4735_rds_status *buf, const bool ack)
+{
+	static struct {
+		uint8_t cmd;
+		struct {
+			uint8_t INTACK     : 1;
+			uint8_t MTFIFO     : 1;
+			uint8_t STATUSONLY : 1;
+			uint8_t pad        : 5;
+		};
+	}
+	c = {
+		.cmd = SI4735_CMD_FM_RDS_STATUS,
+	};
+	PROBE_SCOPE(SI4735_RDS_STATUS);
+
+	if (mode != SI4735_MODE_FM)
+		return false;
+
+	c.INTACK = ack;
+
+	write(&c.cmd, sizeof (c));
+	if (!read_long((uint8_t *) buf, sizeof (*buf)))
+		return false;
+
+	FOREACH (buf->block, b)
+		bswap16(b);
+
+	return true;
+}
+
 bool
 si4735_rsq_status (struct si4735_rsq_status *buf)
 {
@@ -269,6 +582,7 @@ si4735_rsq_status (struct si4735_rsq_status *buf)
 		};
 	} c;
 	size_t size;
+	PROBE_SCOPE(SI4735_RSQ_STATUS);
 
 	switch (mode) {
 	case SI4735_MODE_FM:
@@ -279,6 +593,10 @@ si4735_rsq_status (struct si4735_rsq_status *buf)
 	case SI4735_MODE_AM:
 		c.cmd = SI4735_CMD_AM_RSQ_STATUS;
 		size  = sizeof (*buf) - sizeof (buf->fm);
+
+		// The AM response ends before the FM fields, which read as zero.
+		buf->fm.mult    = 0;
+		buf->fm.freqoff = 0;
 		break;
 
 	default:
@@ -286,7 +604,25 @@ si4735_rsq_status (struct si4735_rsq_status *buf)
 	}
 
 	write(&c.cmd, sizeof (c.cmd));
-	return read_long((uint8_t *) buf, size);
+	if (!read_long((uint8_t *) buf, size))
+		return false;
+
+	cache.rsq       = *buf;
+	cache.rsq_at    = clock_now32();
+	cache.rsq_count = tune_count;
+	cache.rsq_valid = true;
+	return true;
+}
+
+// Get the RSQ status from the cache if possible, else from the chip.
+bool
+si4735_rsq_status_cached (struct si4735_rsq_status *buf)
+{
+	if (!cache_fresh(cache.rsq_valid, cache.rsq_count, cache.rsq_at))
+		return si4735_rsq_status(buf);
+
+	*buf = cache.rsq;
+	return true;
 }
 
 static bool
@@ -305,10 +641,13 @@ power_up (const enum si4735_mode new_mode)
 		uint8_t opmode;
 	}
 	c = {
-		.cmd    = SI4735_CMD_POWER_UP,
-		.XOSCEN = 1,
-		.opmode = SI4735_CMD_POWER_UP_OPMODE_ANALOG_OUT,
+		.cmd     = SI4735_CMD_POWER_UP,
+		.XOSCEN  = 1,
+		.GPO2OEN = 1,
+		.CTSIEN  = 1,
+		.opmode  = SI4735_CMD_POWER_UP_OPMODE_ANALOG_OUT,
 	};
+	PROBE_SCOPE(SI4735_POWER_UP);
 
 	switch (new_mode) {
 	case SI4735_MODE_FM:
@@ -323,20 +662,39 @@ power_up (const enum si4735_mode new_mode)
 		return false;
 	}
 
+	irq = false;
 	write(&c.cmd, sizeof (c));
 
 	// The chip will send 0x80 once to confirm reception.
 	read_status();
 
-	// It returns 0x00 until powerup is done.
-	while ((status = read_status()).raw == 0x00)
-		continue;
+	// It returns 0x00 until powerup is done, and pulses the interrupt
+	// line when it becomes clear to send.
+	const uint32_t until = deadline(SI4735_POWER_UP_MS);
+
+	for (;;) {
+		if (!irq_wait(until))
+			return false;
+
+		if ((status = read_status()).raw != 0x00)
+			break;
+	}
 
 	if (status.ERR)
 		return false;
 
 	mode = new_mode;
-	return true;
+	tune_count++;
+
+	// Signal Seek/Tune Complete on the interrupt line:
+	if (mode != SI4735_MODE_FM)
+		return si4735_prop_set(SI4735_PROP_GPO_IEN, SI4735_PROP_GPO_IEN_STCIEN);
+
+	// In FM mode, also signal when the RDS FIFO holds a few groups:
+	return si4735_prop_set(SI4735_PROP_FM_RDS_INT_SOURCE, SI4735_PROP_FM_RDS_INT_SOURCE_RECV)
+	    && si4735_prop_set(SI4735_PROP_FM_RDS_INT_FIFO_COUNT, 4)
+	    && si4735_prop_set(SI4735_PROP_FM_RDS_CONFIG, SI4735_PROP_FM_RDS_CONFIG_DEFAULT)
+	    && si4735_prop_set(SI4735_PROP_GPO_IEN, SI4735_PROP_GPO_IEN_STCIEN | SI4735_PROP_GPO_IEN_RDSIEN);
 }
 
 bool
@@ -355,13 +713,15 @@ bool
 si4735_power_down (void)
 {
 	static uint8_t cmd[] = { SI4735_CMD_POWER_DOWN };
+	PROBE_SCOPE(SI4735_POWER_DOWN);
 
 	write(cmd, sizeof(cmd));
 
-	if (read_status().ERR)
+	if (!reply_ok())
 		return false;
 
 	mode = SI4735_MODE_DOWN;
+	tune_count++;
 	return true;
 }
 
@@ -377,12 +737,13 @@ si4735_prop_set (uint16_t prop, uint16_t val)
 	c = {
 		.cmd = SI4735_CMD_SET_PROPERTY,
 	};
+	PROBE_SCOPE(SI4735_PROP_SET);
 
 	c.prop = __builtin_bswap16(prop);
 	c.val  = __builtin_bswap16(val);
 
 	write(&c.cmd, sizeof(c));
-	return !read_status().ERR;
+	return reply_ok();
 }
 
 bool
@@ -397,6 +758,7 @@ si4735_prop_get (uint16_t prop, uint16_t *val)
 		.cmd = SI4735_CMD_GET_PROPERTY,
 	};
 	uint8_t buf[4];
+	PROBE_SCOPE(SI4735_PROP_GET);
 
 	c.prop = __builtin_bswap16(prop);
 
@@ -413,6 +775,7 @@ bool
 si4735_rev_get (struct si4735_rev *buf)
 {
 	static uint8_t cmd[] = { SI4735_CMD_GET_REV };
+	PROBE_SCOPE(SI4735_REV_GET);
 	write(cmd, sizeof(cmd));
 	if (!read_long((uint8_t *)buf, sizeof(*buf)))
 		return false;
@@ -421,47 +784,54 @@ si4735_rev_get (struct si4735_rev *buf)
 	return true;
 }
 
+#ifdef SI4735_STATS
+// Get SPI statistics for the command at the given table index.
+bool
+si4735_stats_get (const uint8_t i, struct si4735_stats *buf)
+{
+	if (i >= NELEM(stats))
+		return false;
+
+	*buf     = stats[i];
+	buf->cmd = pgm_read_byte(&cmd_len[i].cmd);
+	return true;
+}
+
+void
+si4735_stats_reset (void)
+{
+	FOREACH (stats, s)
+		*s = (struct si4735_stats) { 0 };
+}
+#endif
+
 void
 si4735_init (void)
 {
 	// Prepare pins as output:
-	DDRB |= _BV(PIN_POWER) | _BV(PIN_RESET) | _BV(PIN_MISO);
+	DDRB |= _BV(PIN_POWER) | _BV(PIN_RESET) | _BV(SPI_PIN_MISO);
 
 	// Power down, keep Reset low:
 	PORTB &= ~_BV(PIN_RESET);
 	PORTB &= ~_BV(PIN_POWER);
 
 	// Select SPI protocol:
-	PORTB |= _BV(PIN_MISO);
-	_delay_ms(1);
+	PORTB |= _BV(SPI_PIN_MISO);
+	clock_delay(1000);
 
 	// Reset sequence:
 	PORTB |= _BV(PIN_POWER);
-	_delay_ms(100);
+	clock_delay(100000);
 
 	PORTB |= _BV(PIN_RESET);
-	_delay_ms(100);
+	clock_delay(100000);
 
 	// Turn on SPI engine:
-	PRR &= ~_BV(PRSPI);
-
-	slave_unselect();
-
-	// SS: make output:
-	DDRB |= _BV(PIN_SS);
-
-	// MISO: make input:
-	DDRB &= ~_BV(PIN_MISO);
-
-	// 32x clock prescaler. The datasheet claims the chip supports transfer
-	// speeds up to 2.5 MHz, but tests show that responses become corrupted
-	// at speeds above 500 KHz.
-	SPCR = _BV(SPR1);
-	SPSR = _BV(SPI2X);
-
-	// Enable SPI and set master mode:
-	SPCR |= _BV(SPE) | _BV(MSTR);
+	spi_init();
 
-	// SCK, MOSI: make output after enabling SPI:
-	DDRB |= _BV(PIN_SCK) | _BV(PIN_MOSI);
+	// INT: make input, interrupt on falling edge:
+	DDRD  &= ~_BV(PIN_INT);
+	EICRA  = _BV(ISC01);
+	EIFR   = _BV(INTF0);
+	EIMSK |= _BV(INT0);
 }
@@ -86,6 +86,42 @@ struct si4735_rsq_status {
 	} fm;
 };
 
+struct si4735_rds_status {
+	struct si4735_status status;
+	struct {
+		uint8_t RDSRECV      : 1;	// FIFO filled to threshold
+		uint8_t RDSSYNCLOST  : 1;	// Lost synchronization
+		uint8_t RDSSYNCFOUND : 1;	// Found synchronization
+		uint8_t pad0         : 1;
+		uint8_t RDSNEWBLOCKA : 1;	// Valid block A found
+		uint8_t RDSNEWBLOCKB : 1;	// Valid block B found
+		uint8_t pad1         : 2;
+	};
+	struct {
+		uint8_t RDSSYNC      : 1;	// Synchronized
+		uint8_t pad2         : 1;
+		uint8_t GRPLOST      : 1;	// FIFO overflowed
+		uint8_t pad3         : 5;
+	};
+	uint8_t  fifo_used;		// Groups in FIFO
+	uint16_t block[4];		// Blocks A to D
+	struct {
+		uint8_t BLED : 2;	// Block errors, 3 is uncorrectable
+		uint8_t BLEC : 2;
+		uint8_t BLEB : 2;
+		uint8_t BLEA : 2;
+	};
+};
+
+// Per-command SPI statistics, for builds with SI4735_STATS.
+struct si4735_stats {
+	uint8_t  cmd;		// Command byte
+	uint16_t calls;		// Number of times written
+	uint16_t bytes;		// Bytes moved, prefixes included
+	uint16_t saved;		// Bytes saved by variable-length reads
+	uint32_t ticks;		// Clock ticks spent in long reads
+};
+
 extern void si4735_init (void);
 extern bool si4735_rev_get (struct si4735_rev *);
 extern bool si4735_prop_get (uint16_t prop, uint16_t *val);
@@ -96,6 +132,14 @@ extern bool si4735_power_down (void);
 extern bool si4735_freq_set (const uint16_t freq, const bool fast, const bool freeze, const bool sw);
 extern bool si4735_tune_status (struct si4735_tune_status *);
 extern bool si4735_rsq_status (struct si4735_rsq_status *);
+extern bool si4735_tune_status_cached (struct si4735_tune_status *);
+extern bool si4735_rsq_status_cached (struct si4735_rsq_status *);
 extern bool si4735_seek_start (const bool up, const bool wrap, const bool sw);
 extern bool si4735_seek_cancel (void);
+extern bool si4735_stc_wait (void);
+extern bool si4735_rds_status (struct si4735_rds_status *, const bool ack);
+extern bool si4735_rds_pending (void);
+extern uint8_t si4735_tune_count (void);
 extern enum si4735_mode si4735_mode_get (void);
+extern bool si4735_stats_get (const uint8_t i, struct si4735_stats *buf);
+extern void si4735_stats_reset (void);
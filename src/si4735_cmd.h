@@ -38,3 +38,28 @@
 #define SI4735_CMD_POWER_UP_OPMODE_DIGITAL_OUT	0x0B
 #define SI4735_CMD_POWER_UP_OPMODE_DIGITAL_OUTS	0xB0
 #define SI4735_CMD_POWER_UP_OPMODE_BOTH_OUTS	0xB5
+
+// Property definitions.
+#define SI4735_PROP_GPO_IEN			0x0001
+#define SI4735_PROP_FM_SEEK_BAND_BOTTOM		0x1400
+#define SI4735_PROP_FM_SEEK_BAND_TOP		0x1401
+#define SI4735_PROP_FM_SEEK_FREQ_SPACING	0x1402
+#define SI4735_PROP_FM_RDS_INT_SOURCE		0x1500
+#define SI4735_PROP_FM_RDS_INT_FIFO_COUNT	0x1501
+#define SI4735_PROP_FM_RDS_CONFIG		0x1502
+#define SI4735_PROP_AM_SEEK_BAND_BOTTOM		0x3400
+#define SI4735_PROP_AM_SEEK_BAND_TOP		0x3401
+#define SI4735_PROP_AM_SEEK_FREQ_SPACING	0x3402
+
+// GPO_IEN bits.
+#define SI4735_PROP_GPO_IEN_STCIEN		0x0001
+#define SI4735_PROP_GPO_IEN_RDSIEN		0x0004
+#define SI4735_PROP_GPO_IEN_RSQIEN		0x0008
+#define SI4735_PROP_GPO_IEN_ERRIEN		0x0040
+#define SI4735_PROP_GPO_IEN_CTSIEN		0x0080
+
+// FM_RDS_INT_SOURCE bits.
+#define SI4735_PROP_FM_RDS_INT_SOURCE_RECV	0x0001
+
+// FM_RDS_CONFIG: accept blocks with up to five corrected errors, enable RDS.
+#define SI4735_PROP_FM_RDS_CONFIG_DEFAULT	0xAA01
@@ -0,0 +1,209 @@
+#include <stddef.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+
+#include "clock.h"
+#include "probe.h"
+#include "spi.h"
+#include "timer.h"
+
+// Settle time between selecting the slave and clocking the first byte. Can be
+// overridden at build time.
+#ifndef SPI_SELECT_DELAY_US
+#define SPI_SELECT_DELAY_US	100
+#endif
+
+// The next transaction is started from the SPI interrupt, so the select
+// delay can hold off the other interrupts. Delays up to this long cost less
+// than setting up a timer and are busy-waited; longer ones are timed by a
+// software timer, so that the UART receiver is not starved.
+#define SPI_SELECT_SPIN_US	10
+
+#if SPI_SELECT_DELAY_US > SPI_SELECT_SPIN_US
+#define SPI_SELECT_TIMER
+#endif
+
+// Queue of pending transactions. The head transaction is in progress.
+static struct spi_xfer *volatile head;
+static struct spi_xfer *tail;
+
+// Index of the byte currently being clocked in the head transaction.
+static uint8_t pos;
+
+// Whether the slave is currently selected.
+static bool selected;
+
+static inline uint8_t
+xfer_size (const struct spi_xfer *x)
+{
+	return x->PREFIX + x->len + x->fill;
+}
+
+// Get the byte to clock out at the given index of the transaction.
+static inline uint8_t
+xfer_byte (const struct spi_xfer *x, uint8_t i)
+{
+	if (x->PREFIX) {
+		if (i == 0)
+			return x->prefix;
+		i--;
+	}
+
+	return (x->tx && i < x->len) ? x->tx[i] : 0x00;
+}
+
+// Clock out the first byte of a transaction.
+static void
+xfer_clock (struct spi_xfer *x)
+{
+	x->start = clock_now();
+	pos = 0;
+	SPDR = xfer_byte(x, 0);
+}
+
+#ifdef SPI_SELECT_TIMER
+// Start the head transaction once the slave has settled.
+static void
+on_selected (struct timer *t)
+{
+	(void) t;
+	xfer_clock(head);
+}
+
+static struct timer select_timer = { .on_expire = on_selected };
+#endif
+
+static void
+xfer_start (struct spi_xfer *x)
+{
+	if (selected) {
+		xfer_clock(x);
+		return;
+	}
+
+	PORTB &= ~_BV(SPI_PIN_SS);
+	selected = true;
+
+#ifdef SPI_SELECT_TIMER
+	timer_start(&select_timer, SPI_SELECT_DELAY_US, 0);
+#else
+	_delay_us(SPI_SELECT_DELAY_US);
+	xfer_clock(x);
+#endif
+}
+
+static void
+xfer_finish (struct spi_xfer *x)
+{
+	if (!x->HOLD) {
+		PORTB |= _BV(SPI_PIN_SS);
+		selected = false;
+	}
+
+	x->ticks = clock_now() - x->start;
+	x->busy  = false;
+
+	PROBE_RECORD(SPI, x->ticks);
+
+	// Start the next transaction before calling the completion handler,
+	// which may queue a new transaction of its own.
+	if ((head = x->next) != NULL)
+		xfer_start(head);
+
+	if (x->on_done)
+		x->on_done(x);
+}
+
+ISR (SPI_STC_vect)
+{
+	struct spi_xfer *x = head;
+	const uint8_t c = SPDR;
+
+	// Save the received byte if it falls in the payload phase. Wraps
+	// around for the prefix byte, so that the test fails.
+	const uint8_t i = pos - x->PREFIX;
+	if (x->rx && i < x->len)
+		x->rx[i] = c;
+
+	if (++pos < xfer_size(x))
+		SPDR = xfer_byte(x, pos);
+	else
+		xfer_finish(x);
+}
+
+// Append a transaction to the queue. Starts the transfer if the bus is idle.
+void
+spi_submit (struct spi_xfer *x)
+{
+	bool idle;
+
+	x->next = NULL;
+	x->busy = true;
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		if ((idle = (head == NULL)))
+			head = x;
+		else
+			tail->next = x;
+
+		tail = x;
+	}
+
+	// Nothing else can start the head transaction, so this is safe to do
+	// with interrupts enabled.
+	if (idle)
+		xfer_start(x);
+}
+
+// Sleep until the given transaction has completed.
+void
+spi_wait (const struct spi_xfer *x)
+{
+	for (;;) {
+
+		// Check atomically if the transaction is done.
+		cli();
+		if (!x->busy) {
+			sei();
+			return;
+		}
+
+		// Sleep until woken by an interrupt.
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+}
+
+void
+spi_init (void)
+{
+	// Turn on SPI engine:
+	PRR &= ~_BV(PRSPI);
+
+	// Deselect slave:
+	PORTB |= _BV(SPI_PIN_SS);
+
+	// SS: make output:
+	DDRB |= _BV(SPI_PIN_SS);
+
+	// MISO: make input:
+	DDRB &= ~_BV(SPI_PIN_MISO);
+
+	// 32x clock prescaler, see SPI_HZ. The datasheet claims the chip
+	// supports transfer speeds up to 2.5 MHz, but tests show that
+	// responses become corrupted at speeds above 500 KHz.
+	SPCR = _BV(SPR1);
+	SPSR = _BV(SPI2X);
+
+	// Enable SPI and its interrupt, set master mode:
+	SPCR |= _BV(SPE) | _BV(SPIE) | _BV(MSTR);
+
+	// SCK, MOSI: make output after enabling SPI:
+	DDRB |= _BV(SPI_PIN_SCK) | _BV(SPI_PIN_MOSI);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// SPI pins on port B:
+#define SPI_PIN_SS	PORTB2
+#define SPI_PIN_MOSI	PORTB3
+#define SPI_PIN_MISO	PORTB4
+#define SPI_PIN_SCK	PORTB5
+
+// SPI clock rate and the time to clock one byte, in microseconds.
+#define SPI_HZ		(F_CPU / 32)
+#define SPI_BYTE_US	(8 * 1000000UL / SPI_HZ)
+
+// A single SPI transaction. The engine selects the slave, clocks out the
+// optional prefix byte, then the payload, then the zero-filled padding, and
+// finally deselects the slave unless the transaction is held. Bytes clocked
+// in during the payload phase are saved into the receive buffer. A
+// transaction must move at least one byte.
+struct spi_xfer {
+	struct spi_xfer *next;		// Next transaction in the queue
+	const uint8_t   *tx;		// Payload to send, or NULL to send zeroes
+	uint8_t         *rx;		// Payload receive buffer, or NULL
+	uint8_t          prefix;	// Prefix byte
+	uint8_t          len;		// Payload length
+	uint8_t          fill;		// Zero bytes sent after the payload
+	struct {
+		uint8_t PREFIX : 1;	// Send the prefix byte
+		uint8_t HOLD   : 1;	// Keep the slave selected when done
+		uint8_t pad    : 6;
+	};
+	void (* on_done) (struct spi_xfer *);	// Called from the SPI interrupt
+	volatile bool    busy;		// Queued or in progress
+	uint16_t         start;		// Clock timestamp at start
+	uint16_t         ticks;		// Duration in clock ticks
+};
+
+extern void spi_init (void);
+extern void spi_submit (struct spi_xfer *);
+extern void spi_wait (const struct spi_xfer *);
@@ -0,0 +1,107 @@
+#include <stddef.h>
+#include <util/atomic.h>
+
+#include "clock.h"
+#include "timer.h"
+
+// Pending timers, soonest first.
+static struct timer *head;
+
+// Take a timer off the list. Called with interrupts disabled.
+static void
+dequeue (struct timer *t)
+{
+	for (struct timer **p = &head; *p; p = &(*p)->next)
+		if (*p == t) {
+			*p = t->next;
+			break;
+		}
+
+	t->running = false;
+}
+
+// Insert a timer in expiry order, after timers that expire at the same
+// time. Called with interrupts disabled.
+static void
+enqueue (struct timer *t)
+{
+	struct timer **p = &head;
+
+	while (*p && (int32_t) ((*p)->when - t->when) <= 0)
+		p = &(*p)->next;
+
+	t->next    = *p;
+	t->running = true;
+	*p         = t;
+}
+
+// Point the clock's alarm at the first timer.
+static void
+alarm_update (void)
+{
+	if (head)
+		clock_alarm(head->when);
+	else
+		clock_alarm_off();
+}
+
+// Start or restart a timer. It expires after the delay, and then every
+// period if that is not zero.
+void
+timer_start (struct timer *t, const uint32_t delay_us, const uint32_t period_us)
+{
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		const uint32_t now = clock_now32();
+
+		if (t->running)
+			dequeue(t);
+
+		t->when   = now + CLOCK_US_TICKS(delay_us);
+		t->period = CLOCK_US_TICKS(period_us);
+
+		enqueue(t);
+		alarm_update();
+	}
+}
+
+void
+timer_stop (struct timer *t)
+{
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		if (t->running) {
+			dequeue(t);
+			alarm_update();
+		}
+	}
+}
+
+// Run the callbacks of all expired timers, and set the alarm for the next.
+// Called from the clock's alarm interrupt.
+void
+timer_run (void)
+{
+	const uint32_t now = clock_now32();
+
+	while (head && (int32_t) (head->when - now) <= 0) {
+		struct timer *t = head;
+
+		head       = t->next;
+		t->running = false;
+
+		// Requeue a periodic timer before its callback, so that the
+		// callback can stop it. After a long delay, skip the missed
+		// periods instead of running them back to back.
+		if (t->period) {
+			t->when += t->period;
+
+			if ((int32_t) (t->when - now) <= 0)
+				t->when = now + t->period;
+
+			enqueue(t);
+		}
+
+		t->on_expire(t);
+	}
+
+	alarm_update();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Software timer. All timers share the clock's alarm interrupt; the pending
+// ones are kept in a list sorted by expiry, and the alarm is set for the
+// first. The callback runs in interrupt context, so it should be short,
+// typically setting a flag for the main loop. It may restart or stop its
+// own timer. The struct must stay alive while the timer is running.
+struct timer {
+	struct timer *next;
+	uint32_t      when;		// Expiry, in clock ticks
+	uint32_t      period;		// Clock ticks, zero for a one-shot
+	void (* on_expire) (struct timer *);
+	bool          running;
+};
+
+extern void timer_start (struct timer *t, const uint32_t delay_us, const uint32_t period_us);
+extern void timer_stop (struct timer *t);
+extern void timer_run (void);
@@ -3,62 +3,222 @@
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <avr/sleep.h>
+#include <util/atomic.h>
 
+#include "format.h"
 #include "uart.h"
 
-#define BAUDRATE	115200
-#define BAUD_PRESCALE	((F_CPU / (BAUDRATE * 8UL)) - 1)
-#define FIFOSIZE	32
+// Baud rate, overridable from the Makefile.
+#ifndef BAUD
+#define BAUD		115200
+#endif
+
+// Largest tolerated baud rate error, in tenths of a percent. The default
+// admits 115200 baud, which is 2.1% off at 16 MHz.
+#ifndef BAUD_TOL
+#define BAUD_TOL	25
+#endif
+
+// Baud rate divisors in normal and double speed mode, rounded to nearest,
+// and the baud rates that they actually give.
+#define UBRR_1X(b)	((F_CPU + 8UL * (b)) / (16UL * (b)) - 1)
+#define UBRR_2X(b)	((F_CPU + 4UL * (b)) / (8UL * (b)) - 1)
+#define RATE_1X(u)	(F_CPU / (16UL * ((u) + 1)))
+#define RATE_2X(u)	(F_CPU / (8UL * ((u) + 1)))
+
+// Baud rate error in tenths of a percent.
+#define BAUD_ERR(rate, b) \
+	((((rate) > (b)) ? (rate) - (b) : (b) - (rate)) * 1000UL / (b))
+
+#define ERR_1X		BAUD_ERR(RATE_1X(UBRR_1X(BAUD)), BAUD)
+#define ERR_2X		BAUD_ERR(RATE_2X(UBRR_2X(BAUD)), BAUD)
+
+// Prefer normal speed, which samples each bit more often, unless double
+// speed is more accurate.
+#if ERR_2X < ERR_1X
+#define BAUD_U2X	1
+#define BAUD_UBRR	UBRR_2X(BAUD)
+#define BAUD_ERROR	ERR_2X
+#else
+#define BAUD_U2X	0
+#define BAUD_UBRR	UBRR_1X(BAUD)
+#define BAUD_ERROR	ERR_1X
+#endif
+
+#if BAUD_UBRR > 0x0FFF
+#error "BAUD is too low for this clock"
+#endif
+
+#if BAUD_ERROR > BAUD_TOL
+#error "BAUD cannot be generated accurately from this clock"
+#endif
+
+// FIFO sizes, overridable from the Makefile. Indices wrap with a mask, so
+// the sizes must be powers of two, and fit the 8-bit indices.
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE	64
+#endif
+
+#ifndef UART_RX_SIZE
+#define UART_RX_SIZE	64
+#endif
+
+#if UART_TX_SIZE & (UART_TX_SIZE - 1) || UART_TX_SIZE > 256
+#error "UART_TX_SIZE must be a power of two, at most 256"
+#endif
+
+#if UART_RX_SIZE & (UART_RX_SIZE - 1) || UART_RX_SIZE > 256
+#error "UART_RX_SIZE must be a power of two, at most 256"
+#endif
+
+#define TX_MASK		(UART_TX_SIZE - 1)
+#define RX_MASK		(UART_RX_SIZE - 1)
+
+// Rx flow control watermarks. The sender is paused when the Rx FIFO fills
+// up to the high mark, and resumed when it drains down to the low mark.
+// The headroom above the high mark absorbs the bytes that are in flight.
+#define RX_HIGH		(UART_RX_SIZE * 3 / 4)
+#define RX_LOW		(UART_RX_SIZE / 4)
+
+// Software flow control characters.
+#define XON		0x11
+#define XOFF		0x13
+
+// Hardware flow control output, active low.
+#define RTS_PORT	PORTD
+#define RTS_DDR		DDRD
+#define RTS_PIN		PORTD4
+
+static volatile struct {
+	uint8_t fifo[UART_TX_SIZE];
+	uint8_t tail;
+	uint8_t head;
+} tx;
 
-static volatile struct fifo {
-	uint8_t fifo[FIFOSIZE];
+static volatile struct {
+	uint8_t fifo[UART_RX_SIZE];
 	uint8_t tail;
 	uint8_t head;
-} rx, tx;
+} rx;
 
 static volatile bool flag_etx = false;
 
-static inline uint8_t
-fifo_inc (uint8_t i)
+// In raw mode, Ctrl-C is received as a regular character. When muted, all
+// output is dropped.
+static volatile bool raw;
+static bool mute;
+
+// Called whenever the UART waits for input.
+static void (* on_idle) (void);
+
+// Current baud rate, and whether any byte was sent yet.
+static uint32_t baud = BAUD;
+static volatile bool tx_sent;
+
+// Whether the sender is paused, and the flow control character that is
+// waiting to jump the Tx queue.
+static volatile bool throttled;
+static volatile uint8_t tx_ctrl;
+
+static volatile struct uart_stats stats;
+
+// Pause the sender. Called with interrupts disabled.
+static inline void
+throttle (void)
+{
+#if defined(UART_FLOW_XON)
+	// Software flow control would corrupt binary data.
+	if (raw)
+		return;
+
+	tx_ctrl = XOFF;
+	UCSR0B |= _BV(UDRIE0);
+#elif defined(UART_FLOW_RTS)
+	RTS_PORT |= _BV(RTS_PIN);
+#else
+	return;
+#endif
+	throttled = true;
+	stats.throttled++;
+}
+
+// Resume the sender. Called with interrupts disabled.
+static inline void
+release (void)
 {
-	return ++i == FIFOSIZE ? 0 : i;
+#if defined(UART_FLOW_XON)
+	tx_ctrl = XON;
+	UCSR0B |= _BV(UDRIE0);
+#elif defined(UART_FLOW_RTS)
+	RTS_PORT &= ~_BV(RTS_PIN);
+#endif
+	throttled = false;
 }
 
 ISR (USART_UDRE_vect, ISR_BLOCK)
 {
+#ifdef UART_FLOW_XON
+	// Flow control characters jump the queue.
+	if (tx_ctrl) {
+		UDR0 = tx_ctrl;
+		tx_ctrl = 0;
+		return;
+	}
+#endif
+
 	// If there is no more data in the ring buffer, disable this interrupt:
 	if (tx.head == tx.tail) {
 		UCSR0B &= ~_BV(UDRIE0);
 		return;
 	}
 
-	// Else feed data to the buffer:
+	// Else feed data to the buffer. Before the last byte, clear the
+	// transmit complete flag, so that uart_flush() can wait for it.
+	const uint8_t tail = (tx.tail + 1) & TX_MASK;
+	if (tail == tx.head) {
+		UCSR0A  = (UCSR0A & _BV(U2X0)) | _BV(TXC0);
+		tx_sent = true;
+	}
+
 	UDR0 = tx.fifo[tx.tail];
-	tx.tail = fifo_inc(tx.tail);
+	tx.tail = tail;
 }
 
 ISR (USART_RX_vect, ISR_BLOCK)
 {
-	// If we have a frame error, read the register and ignore:
-	if (UCSR0A & _BV(FE0)) {
-		volatile uint8_t unused __attribute__((unused)) = UDR0;
+	// Read the status before the data register, which clears it.
+	const uint8_t status = UCSR0A;
+	const uint8_t ch = UDR0;
+
+	// A data overrun means that bytes were lost before this one.
+	if (status & _BV(DOR0))
+		stats.overrun++;
+
+	// Ignore characters with a frame error.
+	if (status & _BV(FE0)) {
+		stats.frame++;
 		return;
 	}
 
-	// Get character:
-	uint8_t ch = UDR0;
-
 	// If it's an End-of-Text (Ctrl-C), handle out of band by setting flag:
-	if (ch == 0x03) {
+	if (ch == 0x03 && !raw) {
 		flag_etx = true;
 		return;
 	}
 
-	// Put the character into the Rx FIFO.
-	const uint8_t next = fifo_inc(rx.head);
+	// Put the character into the Rx FIFO, or drop it if the FIFO is full.
+	const uint8_t next = (rx.head + 1) & RX_MASK;
+	if (next == rx.tail) {
+		stats.dropped++;
+		return;
+	}
+
 	rx.fifo[rx.head] = ch;
-	if (next != rx.tail)
-		rx.head = next;
+	rx.head = next;
+
+	// Pause the sender when reaching the high watermark.
+	if (!throttled && ((next - rx.tail) & RX_MASK) >= RX_HIGH)
+		throttle();
 }
 
 // Return the next character in the Rx FIFO; may block.
@@ -67,13 +227,22 @@ uart_getchar (void)
 {
 	for (;;) {
 
+		// Do background work.
+		if (on_idle)
+			on_idle();
+
 		// Clear interrupts to check the fifo contents.
 		cli();
 
 		// Return if a character is available in the fifo.
 		if (rx.head != rx.tail) {
 			const uint8_t c = rx.fifo[rx.tail];
-			rx.tail = fifo_inc(rx.tail);
+			rx.tail = (rx.tail + 1) & RX_MASK;
+
+			// Resume the sender when reaching the low watermark.
+			if (throttled && ((rx.head - rx.tail) & RX_MASK) <= RX_LOW)
+				release();
+
 			sei();
 			return c;
 		}
@@ -89,6 +258,25 @@ uart_getchar (void)
 	}
 }
 
+// Set a function to call while waiting for input.
+void
+uart_idle (void (* fn) (void))
+{
+	on_idle = fn;
+}
+
+void
+uart_raw (const bool on)
+{
+	raw = on;
+}
+
+void
+uart_mute (const bool on)
+{
+	mute = on;
+}
+
 bool
 uart_flag_etx (void)
 {
@@ -100,159 +288,217 @@ uart_flag_etx (void)
 	return false;
 }
 
+// Get a snapshot of the error counters.
 void
-uart_putc (const uint8_t c)
+uart_stats_get (struct uart_stats *s)
 {
-	const uint8_t next = fifo_inc(tx.head);
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+		*s = stats;
+}
 
-	// If the next character would coincide with the fifo's tail,
-	// wait for a character to be transmitted first:
-	if (next == tx.tail)
-		while (!(UCSR0A & _BV(UDRE0)))
-			continue;
+void
+uart_stats_reset (void)
+{
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+		stats = (struct uart_stats) { 0 };
+}
 
-	tx.fifo[tx.head] = c;
-	tx.head = next;
+// Return the number of free bytes in the Tx FIFO.
+uint8_t
+uart_tx_free (void)
+{
+	return (tx.tail - tx.head - 1) & TX_MASK;
+}
+
+// Queue as many bytes as fit in the Tx FIFO without waiting. Returns the
+// number of bytes queued.
+uint8_t
+uart_try_write (const void *buf, uint8_t len)
+{
+	const uint8_t *src = buf;
+	uint8_t head = tx.head;
+	const uint8_t free = (tx.tail - head - 1) & TX_MASK;
+
+	if (mute)
+		return len;
+
+	if (len > free)
+		len = free;
 
-	// Enable UDR0 Empty interrupt:
+	if (len == 0)
+		return 0;
+
+	for (uint8_t i = 0; i < len; i++) {
+		tx.fifo[head] = src[i];
+		head = (head + 1) & TX_MASK;
+	}
+
+	// Publish the bytes to the interrupt handler in one go, and enable
+	// the UDR0 Empty interrupt once for the whole run.
+	tx.head = head;
 	UCSR0B |= _BV(UDRIE0);
+
+	return len;
 }
 
-// Printf with a RAM-based format string
-static void
-do_printf (bool ram, const char *restrict format, va_list argp)
+// Queue all bytes, sleeping while the Tx FIFO is full.
+void
+uart_write (const void *buf, uint8_t len)
 {
-	static const char PROGMEM hex[] = "0123456789ABCDEF";
-	char c;
-
-	while ((c = (ram) ? *format++ : pgm_read_byte(format++)) != 0)
-	{
-		switch (c)
-		{
-		case '%':
-			switch ((ram) ? *format++ : pgm_read_byte(format++)) {
-			case 0:
-				break;
-
-			case '%':
-				uart_putc('%');
-				break;
-
-			case 'c':
-				uart_putc(va_arg(argp, int));
-				break;
-
-			case 'd': {
-				uint16_t div;
-				int16_t d = va_arg(argp, int16_t);
-				if (d < 0) {
-					uart_putc('-');
-					d = -d;
-				}
-				if (d == 0) {
-					uart_putc('0');
-					break;
-				}
-				for (div = 1; div * 10 <= d; div *= 10)
-					continue;
-
-				while (div) {
-					uint8_t digit = d / div;
-					d -= div * digit;
-					div /= 10;
-					uart_putc('0' + digit);
-				}
-				break;
-			}
-
-			case 's': {
-				const char *s = va_arg(argp, char *);
-				while (*s)
-					uart_putc(*s++);
-				break;
-			}
-
-			case 'p': {
-				const char *s = va_arg(argp, char *);
-				while (pgm_read_byte(s))
-					uart_putc(pgm_read_byte(s++));
-				break;
-			}
-
-			case 'u': {
-				uint16_t div, u = va_arg(argp, uint16_t);
-				if (u == 0) {
-					uart_putc('0');
-					break;
-				}
-				for (div = 1; div * 10 <= u; div *= 10)
-					continue;
-
-				while (div) {
-					uint8_t digit = u / div;
-					u -= div * digit;
-					div /= 10;
-					uart_putc('0' + digit);
-				}
-				break;
-			}
-
-			case 'x': {
-				uint16_t div, x = va_arg(argp, uint16_t);
-				if (x == 0) {
-					uart_putc('0');
-					break;
-				}
-				for (div = 1; div * 16 <= x; div *= 16)
-					continue;
-
-				while (div) {
-					uint8_t digit = x / div;
-					x -= div * digit;
-					div /= 16;
-					uart_putc(pgm_read_byte(hex + digit));
-				}
-				break;
-			}
-			}
-			break;
+	const uint8_t *src = buf;
+
+	for (;;) {
+		const uint8_t n = uart_try_write(src, len);
+
+		if ((len -= n) == 0)
+			return;
 
-		case '\n':
-			uart_putc('\r');
-			// Fallthrough
+		src += n;
+
+		// Sleep until the transmit interrupt frees up space. The
+		// interrupt is enabled, since the FIFO is not empty.
+		cli();
+		if (uart_tx_free() == 0) {
+			set_sleep_mode(SLEEP_MODE_IDLE);
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+		}
+		sei();
+	}
+}
 
-		default:
-			uart_putc(c);
+// Sleep until the Tx FIFO is empty, then wait for the last byte to leave
+// the shift register.
+void
+uart_flush (void)
+{
+	for (;;) {
+		cli();
+		if (tx.head == tx.tail) {
+			sei();
 			break;
 		}
+
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
 	}
+
+	if (tx_sent)
+		while (!(UCSR0A & _BV(TXC0)))
+			continue;
+}
+
+// Find the divisor for a baud rate, and return its error in tenths of a
+// percent. Prefers normal speed mode, like the compile-time version.
+static uint32_t
+divisor (const uint32_t rate, uint16_t *ubrr, bool *u2x)
+{
+	const uint32_t u1 = (F_CPU + 8UL * rate) / (16UL * rate) - 1;
+	const uint32_t u2 = (F_CPU + 4UL * rate) / (8UL * rate) - 1;
+	const uint32_t e1 = BAUD_ERR(RATE_1X(u1), rate);
+	const uint32_t e2 = BAUD_ERR(RATE_2X(u2), rate);
+
+	if ((*u2x = e2 < e1)) {
+		*ubrr = u2;
+		return u2 > 0x0FFF ? UINT32_MAX : e2;
+	}
+
+	*ubrr = u1;
+	return u1 > 0x0FFF ? UINT32_MAX : e1;
+}
+
+// Check if a baud rate can be generated within tolerance.
+bool
+uart_baud_ok (const uint32_t rate)
+{
+	uint16_t ubrr;
+	bool u2x;
+
+	// Rates above F_CPU / 8 have no divisor.
+	if (rate == 0 || rate > F_CPU / 8)
+		return false;
+
+	return divisor(rate, &ubrr, &u2x) <= BAUD_TOL;
+}
+
+uint32_t
+uart_baud (void)
+{
+	return baud;
+}
+
+// Switch to a new baud rate after sending all pending output.
+bool
+uart_baud_set (const uint32_t rate)
+{
+	uint16_t ubrr;
+	bool u2x;
+
+	if (!uart_baud_ok(rate))
+		return false;
+
+	divisor(rate, &ubrr, &u2x);
+	uart_flush();
+
+	ATOMIC_BLOCK (ATOMIC_RESTORESTATE) {
+		UCSR0A = u2x ? _BV(U2X0) : 0;
+		UBRR0  = ubrr;
+	}
+
+	baud = rate;
+	return true;
+}
+
+// Check if a received character is waiting.
+bool
+uart_rx_ready (void)
+{
+	return rx.head != rx.tail;
+}
+
+void
+uart_putc (const uint8_t c)
+{
+	uart_write(&c, 1);
+}
+
+// Output function for the formatter.
+static void
+emit (const char *buf, uint8_t len)
+{
+	uart_write(buf, len);
 }
 
 // Printf with a RAM-based format string
 void
-uart_printf (const char *restrict format, ...)
+uart_printf (const char *restrict fmt, ...)
 {
 	va_list argp;
 
-	if (!format)
+	if (!fmt || mute)
 		return;
 
-	va_start(argp, format);
-	do_printf(true, format, argp);
+	va_start(argp, fmt);
+	format(emit, true, fmt, argp);
 	va_end(argp);
 }
 
 // Printf with a PROGMEM-based format string
 void
-uart_printf_P (const char *restrict format, ...)
+uart_printf_P (const char *restrict fmt, ...)
 {
 	va_list argp;
 
-	if (!format)
+	if (!fmt || mute)
 		return;
 
-	va_start(argp, format);
-	do_printf(false, format, argp);
+	va_start(argp, fmt);
+	format(emit, false, fmt, argp);
 	va_end(argp);
 }
 
@@ -262,16 +508,22 @@ uart_init (void)
 	// Wake up USART0:
 	PRR &= ~_BV(PRUSART0);
 
-	// Set double speed mode:
-	UCSR0A = _BV(U2X0);
+	// Set double speed mode if needed:
+	UCSR0A = BAUD_U2X ? _BV(U2X0) : 0;
 
 	// Set baudrate:
-	UBRR0H = BAUD_PRESCALE >> 8;
-	UBRR0L = BAUD_PRESCALE & 0xFF;
+	UBRR0H = BAUD_UBRR >> 8;
+	UBRR0L = BAUD_UBRR & 0xFF;
 
 	// Set frame format to 8N1:
 	UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
 
+#ifdef UART_FLOW_RTS
+	// Drive RTS low to let the sender go ahead.
+	RTS_PORT &= ~_BV(RTS_PIN);
+	RTS_DDR  |= _BV(RTS_PIN);
+#endif
+
 	// Start rx, tx, and enable rx interrupt:
 	UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
 }
@@ -1,11 +1,32 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// Receive error counters.
+struct uart_stats {
+	uint16_t overrun;	// Bytes lost in the hardware receiver
+	uint16_t frame;		// Bytes dropped for frame errors
+	uint16_t dropped;	// Bytes dropped because the Rx FIFO was full
+	uint16_t throttled;	// Times the sender was paused
+};
+
 extern void uart_init (void);
 extern void uart_putc (const uint8_t c);
+extern uint8_t uart_tx_free (void);
+extern void uart_write (const void *buf, uint8_t len);
+extern uint8_t uart_try_write (const void *buf, uint8_t len);
 extern void uart_printf   (const char *restrict format, ...) __attribute__ ((format (printf, 1, 2)));
 extern void uart_printf_P (const char *restrict format, ...) __attribute__ ((format (printf, 1, 2)));
 extern bool uart_process (void);
 extern const uint8_t *uart_line (void);
 extern bool uart_flag_etx (void);
+extern void uart_idle (void (* fn) (void));
+extern void uart_raw (const bool on);
+extern void uart_mute (const bool on);
 extern uint8_t uart_getchar (void);
+extern void uart_stats_get (struct uart_stats *s);
+extern void uart_stats_reset (void);
+extern void uart_flush (void);
+extern bool uart_rx_ready (void);
+extern bool uart_baud_ok (const uint32_t rate);
+extern bool uart_baud_set (const uint32_t rate);
+extern uint32_t uart_baud (void);
@@ -0,0 +1,371 @@
+// Cycle counts of the firmware under simavr. Runs radiuno.elf, built with
+// PROBE=gpior, against the si4735 model of the host build, and types a
+// script of commands into the console, one line at a time. Times every
+// probe that the firmware marks in GPIOR0, and every command from the
+// moment its Enter key is sent until the prompt is back. Prints the results
+// as CSV, in cycles:
+//
+//   kind,name,calls,min,mean,max
+//
+// Usage: bench <radiuno.elf> <script>
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_spi.h>
+#include <simavr/avr_uart.h>
+
+#include "../host/host.h"
+#include "../src/probe.h"
+
+#define CPU_MHZ		(F_CPU / 1000000)
+
+// Data space address of GPIOR0.
+#define GPIOR0_ADDR	0x3E
+
+// Longest time the model goes unchecked, and the quiet time on the console
+// after which the firmware is considered to be waiting at the prompt.
+#define POLL_CYCLES	(1000 * CPU_MHZ)
+#define QUIET_CYCLES	(20000 * CPU_MHZ)
+
+// Give up after this much simulated time.
+#define LIMIT_CYCLES	(600ULL * 1000000 * CPU_MHZ)
+
+#define MAX_LINES	64
+
+struct stat {
+	const char *name;
+	uint32_t    calls;
+	uint64_t    min;
+	uint64_t    max;
+	uint64_t    total;
+};
+
+#define PROBE_NAME(ID, NAME)	NAME,
+
+static const char *const probe_names[PROBE_COUNT] = {
+	NULL,
+	PROBES(PROBE_NAME)
+};
+
+static avr_t *avr;
+
+// Per-probe statistics, and the cycle count at the last entry of each.
+static struct stat probes[PROBE_COUNT];
+static avr_cycle_count_t entered[PROBE_COUNT];
+
+// Script lines and their latencies; the first entry is the boot.
+static struct stat lines[MAX_LINES + 1] = { { .name = "boot" } };
+static int nlines;
+
+// Console feeder state.
+static avr_irq_t *uart_in;
+static avr_irq_t *int_pin;
+static bool xon = true;
+static int line;		// Line being typed or waited for
+static int pos;			// Next character of the line
+static bool typing;
+static bool waiting = true;	// Waiting for the prompt
+static avr_cycle_count_t sent_at;
+static avr_cycle_count_t last_out;
+
+// Start of the current console output line, to spot the prompt.
+static char out[16];
+static size_t outlen;
+
+// The model's notion of time.
+uint64_t
+host_now (void)
+{
+	return avr->cycle / CPU_MHZ;
+}
+
+static void
+add (struct stat *s, const uint64_t cycles)
+{
+	if (s->calls == 0 || cycles < s->min)
+		s->min = cycles;
+
+	if (cycles > s->max)
+		s->max = cycles;
+
+	s->total += cycles;
+	s->calls++;
+}
+
+static void
+print (const char *kind, const struct stat *s)
+{
+	if (s->calls == 0)
+		return;
+
+	printf("%s,\"%s\",%u,%llu,%llu,%llu\n", kind, s->name, s->calls,
+		(unsigned long long) s->min,
+		(unsigned long long) (s->total / s->calls),
+		(unsigned long long) s->max);
+}
+
+static void
+on_gpior0 (avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+	const uint8_t id = v & ~PROBE_EXIT;
+
+	avr->data[addr] = v;
+
+	if (id == PROBE_NONE || id >= PROBE_COUNT)
+		return;
+
+	if (v & PROBE_EXIT)
+		add(&probes[id], avr->cycle - entered[id]);
+	else
+		entered[id] = avr->cycle;
+}
+
+// Pulse the chip's interrupt line, which triggers INT0 on the falling edge.
+static void
+pulse (void)
+{
+	avr_raise_irq(int_pin, 0);
+	avr_raise_irq(int_pin, 1);
+}
+
+// Time of the model's next event, no further away than the poll interval.
+static avr_cycle_count_t
+model_when (void)
+{
+	const uint64_t next = model_next();
+	const avr_cycle_count_t max = avr->cycle + POLL_CYCLES;
+
+	if (next == HOST_NEVER || next * CPU_MHZ > max)
+		return max;
+
+	return next * CPU_MHZ > avr->cycle ? next * CPU_MHZ : avr->cycle + 1;
+}
+
+static avr_cycle_count_t
+model_timer (avr_t *avr, avr_cycle_count_t when, void *param)
+{
+	if (model_run())
+		pulse();
+
+	return model_when();
+}
+
+// Reschedule the model timer after a command changed the chip's plans.
+static void
+model_schedule (void)
+{
+	avr_cycle_timer_cancel(avr, model_timer, NULL);
+	avr_cycle_timer_register(avr, model_when() - avr->cycle, model_timer, NULL);
+}
+
+static void
+on_spi (avr_irq_t *irq, uint32_t value, void *param)
+{
+	avr_raise_irq((avr_irq_t *) param, model_xfer(value));
+
+	if (model_run())
+		pulse();
+
+	model_schedule();
+}
+
+static void
+on_select (avr_irq_t *irq, uint32_t value, void *param)
+{
+	if (value)
+		model_deselect();
+	else
+		model_select();
+}
+
+// Type the current line, as far as the receiver takes it.
+static void
+feed (void)
+{
+	while (typing && xon) {
+		const char c = lines[line].name[pos] ? lines[line].name[pos++] : '\r';
+
+		avr_raise_irq(uart_in, c);
+
+		if (c == '\r') {
+			typing  = false;
+			waiting = true;
+			sent_at = avr->cycle;
+		}
+	}
+}
+
+static void
+on_xon (avr_irq_t *irq, uint32_t value, void *param)
+{
+	xon = true;
+	feed();
+}
+
+static void
+on_xoff (avr_irq_t *irq, uint32_t value, void *param)
+{
+	xon = false;
+}
+
+// Whether a line is the prompt: the band, the frequency if tuned, and " > ".
+static bool
+is_prompt (const char *s, const size_t len)
+{
+	size_t i = 2;
+
+	if (len < 5 || len > sizeof (out) || memcmp(s + len - 3, " > ", 3))
+		return false;
+
+	for (size_t j = 0; j < 2; j++)
+		if (!islower((unsigned char) s[j]) && s[j] != '-')
+			return false;
+
+	if (s[i] == ' ' && isdigit((unsigned char) s[i + 1]))
+		for (i++; isdigit((unsigned char) s[i]); i++)
+			continue;
+
+	return i == len - 3;
+}
+
+// Watch the console output for the end of the prompt, which starts a line.
+// Matching all of it keeps a '> ' in the output of a command from ending it.
+static void
+on_uart (avr_irq_t *irq, uint32_t value, void *param)
+{
+	if (value == '\r' || value == '\n')
+		outlen = 0;
+	else if (outlen++ < sizeof (out))
+		out[outlen - 1] = value;
+
+	if (waiting && value == ' ' && is_prompt(out, outlen)) {
+		add(&lines[line], avr->cycle - sent_at);
+		waiting = false;
+	}
+
+	last_out = avr->cycle;
+}
+
+static void
+load_script (const char *path)
+{
+	char buf[80];
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	while (nlines < MAX_LINES && fgets(buf, sizeof (buf), f)) {
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (buf[0] != '\0' && buf[0] != '#')
+			lines[++nlines].name = strdup(buf);
+	}
+
+	fclose(f);
+}
+
+static void
+connect (void)
+{
+	uint32_t flags = 0;
+
+	// Keep the console off stdout, which carries the results.
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+	uart_in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), on_uart, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON), on_xon, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF), on_xoff, NULL);
+
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT), on_spi,
+		avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT));
+
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 2), on_select, NULL);
+
+	// The interrupt line idles high.
+	int_pin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+	avr_raise_irq(int_pin, 1);
+
+	avr_register_io_write(avr, GPIOR0_ADDR, on_gpior0, NULL);
+	avr_cycle_timer_register(avr, POLL_CYCLES, model_timer, NULL);
+}
+
+int
+main (int argc, char **argv)
+{
+	elf_firmware_t fw = { { 0 } };
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <radiuno.elf> <script>\n", argv[0]);
+		return 1;
+	}
+
+	load_script(argv[2]);
+
+	if (elf_read_firmware(argv[1], &fw) != 0) {
+		fprintf(stderr, "%s: cannot read firmware\n", argv[1]);
+		return 1;
+	}
+
+	if ((avr = avr_make_mcu_by_name("atmega328p")) == NULL)
+		return 1;
+
+	avr_init(avr);
+	avr_load_firmware(avr, &fw);
+	avr->frequency = F_CPU;
+	connect();
+
+	for (;;) {
+		const int state = avr_run(avr);
+
+		if (state == cpu_Done || state == cpu_Crashed) {
+			fprintf(stderr, "bench: firmware stopped at cycle %llu\n",
+				(unsigned long long) avr->cycle);
+			return 1;
+		}
+
+		if (avr->cycle > LIMIT_CYCLES) {
+			fprintf(stderr, "bench: timed out on line %d\n", line);
+			return 1;
+		}
+
+		// Type the next line once the prompt is back and the console
+		// has gone quiet.
+		if (waiting || typing || avr->cycle - last_out < QUIET_CYCLES)
+			continue;
+
+		if (line == nlines)
+			break;
+
+		line++;
+		pos    = 0;
+		typing = true;
+		sent_at = avr->cycle;
+		feed();
+	}
+
+	printf("kind,name,calls,min,mean,max\n");
+
+	for (int i = 1; i < PROBE_COUNT; i++) {
+		probes[i].name = probe_names[i];
+		print("probe", &probes[i]);
+	}
+
+	for (int i = 0; i <= nlines; i++)
+		print("command", &lines[i]);
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+#
+# Map the output of 'prof dump' to function names.
+#
+# Usage: prof.py <radiuno.elf | radiuno.map> [dump.txt]
+#
+# Reads the dump from the file or from stdin; console noise around it, such
+# as the prompt, is skipped. Function addresses come from the ELF file
+# through avr-nm (override with $NM), or from the linker map. A bucket that
+# spans several functions is split between them by the bytes each covers,
+# so small functions get approximate counts.
+
+import os
+import re
+import subprocess
+import sys
+
+
+def symbols_elf(path):
+    nm = os.environ.get('NM', 'avr-nm')
+    out = subprocess.run([nm, '-n', '--defined-only', path],
+                         check=True, capture_output=True, text=True).stdout
+    syms = []
+    for line in out.splitlines():
+        f = line.split()
+        if len(f) == 3 and f[1] in 'tTwW':
+            syms.append((int(f[0], 16), f[2]))
+    return syms
+
+
+def symbols_map(path):
+    syms = []
+    in_text = False
+    for line in open(path):
+        if re.match(r'^\.text\s', line):
+            in_text = True
+            continue
+        if in_text and re.match(r'^\.\w', line):
+            break
+        m = re.match(r'^\s+0x([0-9a-f]+)\s+([A-Za-z_]\w*)\s*$', line)
+        if in_text and m:
+            syms.append((int(m.group(1), 16), m.group(2)))
+    return sorted(syms)
+
+
+def parse_dump(lines):
+    size = None
+    other = lost = 0
+    buckets = []
+    for line in lines:
+        f = line.split()
+        if len(f) == 4 and f[0] == 'prof' and size is None:
+            size, other, lost = int(f[1]), int(f[2]), int(f[3])
+        elif size is not None and len(f) == 2 and re.fullmatch(r'[0-9a-f]+', f[0]) and f[1].isdigit():
+            buckets.append((int(f[0], 16), int(f[1])))
+    if size is None:
+        sys.exit('prof.py: no dump found')
+    return size, other, lost, buckets
+
+
+def attribute(syms, size, buckets):
+    counts = {}
+    bounds = syms + [(1 << 16, None)]
+    for start, n in buckets:
+        end = start + size
+        for (a, name), (b, _) in zip(bounds, bounds[1:]):
+            lo, hi = max(a, start), min(b, end)
+            if lo < hi:
+                counts[name] = counts.get(name, 0) + n * (hi - lo) / size
+        if start < bounds[0][0]:
+            lo, hi = start, min(end, bounds[0][0])
+            counts['(vectors)'] = counts.get('(vectors)', 0) + n * (hi - lo) / size
+    return counts
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit('usage: prof.py <radiuno.elf | radiuno.map> [dump.txt]')
+
+    path = sys.argv[1]
+    syms = symbols_map(path) if path.endswith('.map') else symbols_elf(path)
+    dump = open(sys.argv[2]) if len(sys.argv) == 3 else sys.stdin
+    size, other, lost, buckets = parse_dump(dump)
+
+    counts = attribute(syms, size, buckets)
+    total = sum(n for _, n in buckets) + other + lost
+    if total == 0:
+        sys.exit('prof.py: no samples')
+
+    print('%8s %6s  %s' % ('samples', '%', 'function'))
+    for name, n in sorted(counts.items(), key=lambda kv: -kv[1]):
+        print('%8.1f %6.2f  %s' % (n, 100 * n / total, name))
+    if other:
+        print('%8d %6.2f  (outside)' % (other, 100 * other / total))
+    if lost:
+        print('%8d %6.2f  (lost)' % (lost, 100 * lost / total))
+    print('bucket size %u bytes, %u samples' % (size, total))
+
+
+if __name__ == '__main__':
+    main()
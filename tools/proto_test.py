@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+#
+# Check that the binary protocol serves pipelined requests. Runs the host
+# build with a sender that ignores flow control and switches to binary mode.
+# Then sends a slow tune request and, back to back behind it, two requests
+# of the maximum length, which wait in the receive FIFO while the tune runs.
+# Each request must be answered in order, with the right frequency.
+#
+# Usage: proto_test.py <radiuno-host>
+
+import os
+import re
+import select
+import subprocess
+import sys
+
+SYNC = 0xA5
+OP_EXEC = 0x01
+OP_EXIT = 0x7F
+OK = 0
+
+# Tune status: chip status, flags, freq, rssi, snr, mult, readantcap.
+TUNE_STATUS_LEN = 8
+
+# Seconds to wait for a response.
+TIMEOUT = 30
+
+
+def proto_max():
+    path = os.path.join(os.path.dirname(__file__), '..', 'src', 'proto.h')
+    return int(re.search(r'#define PROTO_MAX\s+(\d+)', open(path).read())[1])
+
+
+def crc8(data):
+    crc = 0
+    for c in data:
+        crc ^= c
+        for _ in range(8):
+            crc = (crc << 1 ^ 0x07 if crc & 0x80 else crc << 1) & 0xFF
+    return crc
+
+
+def frame(op, seq, data=b''):
+    body = bytes([len(data), op, seq]) + data
+    return bytes([SYNC]) + body + bytes([crc8(body)])
+
+
+class Console:
+    def __init__(self, path):
+        env = dict(os.environ, RADIUNO_FLOW='none', RADIUNO_TIME='fast')
+        env.pop('RADIUNO_PTY', None)
+        env.pop('RADIUNO_LINE_MS', None)
+        self.proc = subprocess.Popen([path], env=env,
+                                     stdin=subprocess.PIPE,
+                                     stdout=subprocess.PIPE)
+        self.buf = b''
+        self.pos = None
+        self.seq = 0
+
+    # Input that does not come from a terminal has its line endings
+    # translated, so pick sequence numbers that keep CR and LF out.
+    def frame(self, op, data=b''):
+        self.seq += 1
+        while set(b'\r\n') & set(frame(op, self.seq, data)):
+            self.seq += 1
+        return self.seq, frame(op, self.seq, data)
+
+    def send(self, data):
+        self.proc.stdin.write(data)
+        self.proc.stdin.flush()
+
+    def read(self):
+        fd = self.proc.stdout.fileno()
+        if not select.select([fd], [], [], TIMEOUT)[0]:
+            sys.exit('no response')
+        chunk = os.read(fd, 4096)
+        if not chunk:
+            sys.exit('console closed')
+        self.buf += chunk
+
+    def prompt(self):
+        while not re.search(rb'[a-z-]{2}( \d+)? > $', self.buf):
+            self.read()
+
+    # Switch to binary mode. Until then, the firmware takes 0x03 as
+    # Ctrl-C, so frames must wait until the command has been echoed.
+    def binary(self):
+        self.prompt()
+        self.send(b'binary\n')
+        while b'binary\r\n' not in self.buf:
+            self.read()
+        self.pos = self.buf.index(b'binary\r\n') + 8
+
+    # Return the next response frame as (op, seq, data).
+    def response(self):
+        while len(self.buf) < self.pos + 2 or \
+                len(self.buf) < self.pos + 5 + self.buf[self.pos + 1]:
+            self.read()
+
+        p, n = self.pos, self.buf[self.pos + 1]
+        if self.buf[p] != SYNC or crc8(self.buf[p + 1:p + 5 + n]):
+            sys.exit('bad response frame: %r' % self.buf[p:p + 5 + n])
+
+        self.pos += 5 + n
+        return self.buf[p + 2], self.buf[p + 3], self.buf[p + 4:p + 4 + n]
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait(TIMEOUT)
+
+
+def check(console, op, seq, freq=None):
+    rop, rseq, data = console.response()
+
+    if rop != op | 0x80 or rseq != seq:
+        sys.exit('request %02x/%d answered as %02x/%d' % (op, seq, rop, rseq))
+    if data[:1] != bytes([OK]):
+        sys.exit('request %02x/%d failed with status %d' % (op, seq, data[0]))
+    if freq is None:
+        return
+    if len(data) != 1 + TUNE_STATUS_LEN:
+        sys.exit('request %02x/%d returned %d bytes' % (op, seq, len(data)))
+    if data[3] | data[4] << 8 != freq:
+        sys.exit('request %02x/%d tuned to %d' % (op, seq, data[3] | data[4] << 8))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit('Usage: %s <radiuno-host>' % sys.argv[0])
+
+    pad = proto_max()
+    console = Console(sys.argv[1])
+
+    reqs = [(console.frame(OP_EXEC, b'tune 9930'), 9930),
+            (console.frame(OP_EXEC, b'tune 8810'.ljust(pad)), 8810),
+            (console.frame(OP_EXEC, b'info'.ljust(pad)), 8810)]
+
+    console.binary()
+    console.send(b''.join(f for (_, f), _ in reqs))
+
+    for (seq, _), freq in reqs:
+        check(console, OP_EXEC, seq, freq)
+
+    seq, f = console.frame(OP_EXIT)
+    console.send(f)
+    check(console, OP_EXIT, seq)
+    console.close()
+
+    print('%d pipelined requests served' % (len(reqs) + 1))
+
+
+if __name__ == '__main__':
+    main()